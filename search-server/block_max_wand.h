@@ -0,0 +1,125 @@
+#pragma once
+#include "posting_list.h"
+#include "top_documents.h"
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+struct WandTerm {
+    const PostingList* postings;
+    double inverse_document_freq;
+};
+
+// Block-Max WAND: обходит списки плюс-слов одновременно и пропускает документы,
+// чья верхняя оценка релевантности (по спискам целиком, затем по текущим блокам)
+// не позволяет войти в top. Результат совпадает с полным перебором: релевантность
+// кандидата суммируется в том же порядке слов.
+// term_freq(ordinal, count) - TF слова в документе,
+// make_document(ordinal, relevance, document) - false, если документ не проходит фильтр.
+template <typename TermFreq, typename MakeDocument>
+void RunBlockMaxWand(const std::vector<WandTerm>& plus_terms, const std::vector<const PostingList*>& minus_terms,
+                     TermFreq term_freq, MakeDocument make_document, TopDocuments& top) {
+    struct Cursor {
+        PostingList::Iterator it;
+        double inverse_document_freq;
+        double max_score;
+        size_t term_index;
+    };
+    const uint32_t END = std::numeric_limits<uint32_t>::max();
+
+    std::vector<Cursor> storage;
+    storage.reserve(plus_terms.size());
+    for (size_t i = 0; i < plus_terms.size(); ++i) {
+        const WandTerm& term = plus_terms[i];
+        storage.push_back({term.postings->begin(), term.inverse_document_freq,
+                           term.postings->GetMaxTermFreq() * term.inverse_document_freq, i});
+    }
+    std::vector<Cursor*> cursors;
+    for (Cursor& cursor : storage) {
+        cursors.push_back(&cursor);
+    }
+    std::vector<PostingList::Iterator> minus_cursors;
+    for (const PostingList* postings : minus_terms) {
+        minus_cursors.push_back(postings->begin());
+    }
+    std::vector<double> contributions(plus_terms.size(), 0.0);
+
+    const auto current = [END](const Cursor* cursor) {
+        return cursor->it.IsValid() ? cursor->it.GetOrdinal() : END;
+    };
+
+    while (true) {
+        std::sort(cursors.begin(), cursors.end(), [&current](const Cursor* lhs, const Cursor* rhs) {
+            return current(lhs) < current(rhs);
+        });
+        while (!cursors.empty() && !cursors.back()->it.IsValid()) {
+            cursors.pop_back();
+        }
+        if (cursors.empty()) {
+            break;
+        }
+
+        // документ входит в top, только если его релевантность больше threshold
+        const double threshold = top.IsFull() ? top.GetWorst().relevance - EPSILON
+                                              : -std::numeric_limits<double>::infinity();
+        double upper_bound = 0.0;
+        size_t pivot = cursors.size();
+        for (size_t i = 0; i < cursors.size(); ++i) {
+            upper_bound += cursors[i]->max_score;
+            if (upper_bound > threshold) {
+                pivot = i;
+                break;
+            }
+        }
+        if (pivot == cursors.size()) {
+            break;
+        }
+        const uint32_t pivot_ordinal = current(cursors[pivot]);
+        while (pivot + 1 < cursors.size() && current(cursors[pivot + 1]) == pivot_ordinal) {
+            ++pivot;
+        }
+
+        if (current(cursors[0]) != pivot_ordinal) {
+            // документы до pivot_ordinal не наберут нужной релевантности
+            for (size_t i = 0; i < pivot && current(cursors[i]) < pivot_ordinal; ++i) {
+                cursors[i]->it.SkipTo(pivot_ordinal);
+            }
+            continue;
+        }
+
+        double block_bound = 0.0;
+        uint32_t next_ordinal = pivot + 1 < cursors.size() ? current(cursors[pivot + 1]) : END;
+        for (size_t i = 0; i <= pivot; ++i) {
+            block_bound += cursors[i]->it.GetBlockMaxTermFreq() * cursors[i]->inverse_document_freq;
+            next_ordinal = std::min(next_ordinal, cursors[i]->it.GetBlockLastOrdinal() + 1);
+        }
+        if (block_bound <= threshold) {
+            // до конца текущих блоков ни один документ не пройдёт порог
+            for (size_t i = 0; i <= pivot; ++i) {
+                cursors[i]->it.SkipTo(next_ordinal);
+            }
+            continue;
+        }
+
+        for (size_t i = 0; i <= pivot; ++i) {
+            const Cursor& cursor = *cursors[i];
+            contributions[cursor.term_index] = term_freq(pivot_ordinal, cursor.it.GetCount()) * cursor.inverse_document_freq;
+        }
+        double relevance = 0.0;
+        for (double& contribution : contributions) {
+            relevance += contribution;
+            contribution = 0.0;
+        }
+        const bool excluded = std::any_of(minus_cursors.begin(), minus_cursors.end(), [pivot_ordinal](PostingList::Iterator& it) {
+            it.SkipTo(pivot_ordinal);
+            return it.IsValid() && it.GetOrdinal() == pivot_ordinal;
+        });
+        Document document;
+        if (!excluded && make_document(pivot_ordinal, relevance, document)) {
+            top.Push(document);
+        }
+        for (size_t i = 0; i <= pivot; ++i) {
+            cursors[i]->it.Next();
+        }
+    }
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+// Массив, который либо владеет элементами, либо ссылается на чужую неизменяемую
+// память (например, на отображённый в память снимок индекса). Первое изменение
+// копирует элементы к себе, поэтому снимок можно читать без десериализации.
+template <typename T>
+class CowArray {
+public:
+    CowArray() = default;
+
+    static CowArray View(const T* data, size_t size) {
+        CowArray result;
+        result.view_ = data;
+        result.view_size_ = size;
+        return result;
+    }
+
+    size_t size() const {
+        return view_ ? view_size_ : owned_.size();
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    const T* data() const {
+        return view_ ? view_ : owned_.data();
+    }
+
+    const T& operator[](size_t index) const {
+        return data()[index];
+    }
+
+    const T* begin() const {
+        return data();
+    }
+
+    const T* end() const {
+        return data() + size();
+    }
+
+    const T& back() const {
+        return data()[size() - 1];
+    }
+
+    T& MutableBack() {
+        Detach();
+        return owned_.back();
+    }
+
+    void push_back(const T& value) {
+        Detach();
+        owned_.push_back(value);
+    }
+
+    // память своих элементов не освобождается
+    void clear() {
+        view_ = nullptr;
+        view_size_ = 0;
+        owned_.clear();
+    }
+
+    void resize(size_t size, const T& value = T()) {
+        Detach();
+        owned_.resize(size, value);
+    }
+
+    // чужая память сюда не входит
+    size_t MemoryUsage() const {
+        return owned_.capacity() * sizeof(T);
+    }
+
+private:
+    void Detach() {
+        if (view_) {
+            owned_.assign(view_, view_ + view_size_);
+            view_ = nullptr;
+            view_size_ = 0;
+        }
+    }
+
+    std::vector<T> owned_;
+    const T* view_ = nullptr;
+    size_t view_size_ = 0;
+};
@@ -0,0 +1,139 @@
+#include "forward_index.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+using namespace std;
+
+namespace {
+
+// перемешивание битов из MurmurHash3
+uint64_t MixBits(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDull;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53ull;
+    value ^= value >> 33;
+    return value;
+}
+
+} // namespace
+
+TermSetFingerprint ComputeFingerprint(DocumentTerms terms) {
+    // две половины считаются независимо, с разными начальными значениями и множителями
+    TermSetFingerprint fingerprint{0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full};
+    for (const TermFrequency& term : terms) {
+        fingerprint.low = (fingerprint.low ^ MixBits(term.term_id)) * 0x100000001B3ull;
+        fingerprint.high = (fingerprint.high ^ MixBits(term.term_id + 0x165667B19E3779F9ull)) * 0x9FB21C651E98DF25ull;
+    }
+    fingerprint.low = MixBits(fingerprint.low ^ terms.size());
+    fingerprint.high = MixBits(fingerprint.high + terms.size());
+    return fingerprint;
+}
+
+bool HaveSameTerms(DocumentTerms lhs, DocumentTerms rhs) {
+    return equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const TermFrequency& left, const TermFrequency& right) {
+        return left.term_id == right.term_id;
+    });
+}
+
+void ForwardIndex::Add(int document_id, const vector<TermFrequency>& terms) {
+    TermFrequency* data = Allocate(terms.size());
+    copy(terms.begin(), terms.end(), data);
+    slots_.emplace(document_id, static_cast<uint32_t>(runs_.size()));
+    runs_.push_back({data, static_cast<uint32_t>(terms.size()), document_id, false});
+    entry_count_ += terms.size() + 1;
+}
+
+bool ForwardIndex::Remove(int document_id) {
+    const auto it = slots_.find(document_id);
+    if (it == slots_.end()) {
+        return false;
+    }
+    Run& run = runs_[it->second];
+    run.removed = true;
+    slots_.erase(it);
+    // перепаковка переносит не больше записей, чем удалено с прошлой, - в среднем O(1) на удаление
+    removed_entry_count_ += run.size + 1;
+    if (removed_entry_count_ >= MIN_REPACK_ENTRY_COUNT && 2 * removed_entry_count_ >= entry_count_) {
+        Compact();
+    }
+    return true;
+}
+
+DocumentTerms ForwardIndex::Find(int document_id) const {
+    const auto it = slots_.find(document_id);
+    if (it == slots_.end()) {
+        return {};
+    }
+    const Run& run = runs_[it->second];
+    return {run.data, run.size};
+}
+
+void ForwardIndex::Compact() {
+    ForwardIndex result;
+    result.runs_.reserve(slots_.size());
+    result.slots_.reserve(slots_.size());
+    for (const Run& run : runs_) {
+        if (!run.removed) {
+            TermFrequency* data = result.Allocate(run.size);
+            copy(run.data, run.data + run.size, data);
+            result.slots_.emplace(run.document_id, static_cast<uint32_t>(result.runs_.size()));
+            result.runs_.push_back({data, run.size, run.document_id, false});
+            result.entry_count_ += run.size + 1;
+        }
+    }
+    *this = move(result);
+}
+
+void ForwardIndex::WriteTo(SnapshotWriter& writer) const {
+    vector<int> document_ids;
+    vector<uint64_t> offsets;
+    vector<TermFrequency> entries;
+    ForEachDocument([&](int document_id, DocumentTerms terms) {
+        document_ids.push_back(document_id);
+        offsets.push_back(entries.size());
+        entries.insert(entries.end(), terms.begin(), terms.end());
+    });
+    offsets.push_back(entries.size());
+    writer.WriteArray(document_ids);
+    writer.WriteArray(offsets);
+    writer.WriteArray(entries);
+}
+
+ForwardIndex ForwardIndex::ReadFrom(SnapshotReader& reader) {
+    const auto document_ids = reader.ReadArray<int>();
+    const auto offsets = reader.ReadArray<uint64_t>();
+    const auto entries = reader.ReadArray<TermFrequency>();
+    if (offsets.size() != document_ids.size() + 1 || offsets[0] != 0 || offsets.back() != entries.size()
+        || !is_sorted(offsets.begin(), offsets.end())) {
+        throw runtime_error("Snapshot is corrupted"s);
+    }
+    ForwardIndex result;
+    result.runs_.reserve(document_ids.size());
+    result.slots_.reserve(document_ids.size());
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        if (!result.slots_.emplace(document_ids[i], static_cast<uint32_t>(i)).second) {
+            throw runtime_error("Snapshot is corrupted"s);
+        }
+        result.runs_.push_back({entries.data() + offsets[i], static_cast<uint32_t>(offsets[i + 1] - offsets[i]), document_ids[i], false});
+    }
+    result.entry_count_ = entries.size() + document_ids.size();
+    return result;
+}
+
+TermFrequency* ForwardIndex::Allocate(size_t count) {
+    if (count == 0) {
+        return nullptr;
+    }
+    // длинный документ получает собственный блок, чтобы не бросать остаток текущего
+    if (count > BLOCK_SIZE / 4) {
+        return blocks_.emplace_back(new TermFrequency[count]).get();
+    }
+    if (BLOCK_SIZE - block_used_ < count) {
+        current_block_ = blocks_.emplace_back(new TermFrequency[BLOCK_SIZE]).get();
+        block_used_ = 0;
+    }
+    TermFrequency* result = current_block_ + block_used_;
+    block_used_ += count;
+    return result;
+}
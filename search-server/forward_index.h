@@ -0,0 +1,138 @@
+#pragma once
+#include "snapshot_io.h"
+#include "term_dictionary.h"
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+struct TermFrequency {
+    TermId term_id;
+    uint32_t reserved;   // выравнивание, всегда 0
+    double freq;
+};
+
+// Слова документа по возрастанию term_id: указатель на отрезок прямого индекса, без копирования.
+class DocumentTerms {
+public:
+    DocumentTerms() = default;
+
+    DocumentTerms(const TermFrequency* data, size_t size)
+        : data_(data)
+        , size_(size) {
+    }
+
+    const TermFrequency* begin() const {
+        return data_;
+    }
+
+    const TermFrequency* end() const {
+        return data_ + size_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+private:
+    const TermFrequency* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// 128-битный отпечаток набора слов документа (частоты не учитываются). У одинаковых наборов
+// отпечатки равны; равенство отпечатков у разных наборов почти невозможно, но не исключено,
+// поэтому совпадение проверяется сравнением самих наборов.
+struct TermSetFingerprint {
+    uint64_t low = 0;
+    uint64_t high = 0;
+
+    bool operator==(const TermSetFingerprint& other) const {
+        return low == other.low && high == other.high;
+    }
+};
+
+struct TermSetFingerprintHash {
+    size_t operator()(const TermSetFingerprint& fingerprint) const {
+        return static_cast<size_t>(fingerprint.low);
+    }
+};
+
+TermSetFingerprint ComputeFingerprint(DocumentTerms terms);
+
+// true, если наборы слов совпадают
+bool HaveSameTerms(DocumentTerms lhs, DocumentTerms rhs);
+
+// Прямой индекс: слова каждого документа лежат одним непрерывным отрезком в общей памяти,
+// которая выделяется блоками и не перемещается. Отрезки адресуются плотной таблицей по номеру
+// документа в порядке добавления, номер по id находится хеш-таблицей, так что Find - O(1).
+// Память удалённых документов возвращается перепаковкой, как только они занимают половину
+// записей, поэтому DocumentTerms остаётся валидным до следующего Remove или Compact.
+// Синхронизацию обеспечивает владелец.
+class ForwardIndex {
+public:
+    // terms упорядочены по term_id
+    void Add(int document_id, const std::vector<TermFrequency>& terms);
+
+    // false, если документа нет; может перепаковать индекс
+    bool Remove(int document_id);
+
+    // пустой вид, если документа нет
+    DocumentTerms Find(int document_id) const;
+
+    bool Contains(int document_id) const {
+        return slots_.count(document_id) > 0;
+    }
+
+    size_t size() const {
+        return slots_.size();
+    }
+
+    // отрезки оставшихся документов переносятся в новую память подряд
+    void Compact();
+
+    // записи (слова и отрезки) удалённых документов, ещё занимающие память
+    size_t GetRemovedEntryCount() const {
+        return removed_entry_count_;
+    }
+
+    void WriteTo(SnapshotWriter& writer) const;
+    // отрезки ссылаются на память снимка
+    static ForwardIndex ReadFrom(SnapshotReader& reader);
+
+    // document_id, terms для каждого документа в порядке добавления
+    template <typename Callback>
+    void ForEachDocument(Callback callback) const {
+        for (const Run& run : runs_) {
+            if (!run.removed) {
+                callback(run.document_id, DocumentTerms(run.data, run.size));
+            }
+        }
+    }
+
+private:
+    static const size_t BLOCK_SIZE = 16 * 1024;   // записей в блоке
+    // перепаковка не раньше, чем удалённые займут блок: мелкий индекс не перестраивается на каждом Remove
+    static const size_t MIN_REPACK_ENTRY_COUNT = BLOCK_SIZE;
+
+    struct Run {
+        const TermFrequency* data;
+        uint32_t size;
+        int document_id;
+        bool removed;
+    };
+
+    TermFrequency* Allocate(size_t count);
+
+    std::vector<std::unique_ptr<TermFrequency[]>> blocks_;
+    TermFrequency* current_block_ = nullptr;
+    size_t block_used_ = BLOCK_SIZE;
+    std::vector<Run> runs_;
+    std::unordered_map<int, uint32_t> slots_;   // id -> номер в runs_
+    // отрезок весит как его слова и ещё одна запись: пустые документы тоже занимают runs_
+    size_t entry_count_ = 0;
+    size_t removed_entry_count_ = 0;
+};
@@ -0,0 +1,202 @@
+#include "index_segment.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <utility>
+using namespace std;
+
+void IndexSegment::DocumentColumns::push_back(const DocumentInfo& document) {
+    ids.push_back(document.id);
+    ratings.push_back(document.rating);
+    statuses.push_back(document.status);
+    lengths.push_back(document.length);
+}
+
+IndexSegment::IndexSegment(DocumentColumns documents, CowArray<TermId> terms, PostingArena postings)
+    : documents_(move(documents))
+    , terms_(move(terms))
+    , arena_(move(postings))
+    , postings_(arena_.GetLists()) {
+    InitRemovedMarks();
+    InitStatusMasks();
+    vector<IdEntry> id_index;
+    id_index.reserve(documents_.size());
+    for (uint32_t ordinal = 0; ordinal < documents_.size(); ++ordinal) {
+        id_index.push_back({documents_.ids[ordinal], ordinal});
+    }
+    sort(id_index.begin(), id_index.end(), [](const IdEntry& lhs, const IdEntry& rhs) {
+        return lhs.id < rhs.id;
+    });
+    for (const IdEntry& entry : id_index) {
+        id_index_.push_back(entry);
+    }
+}
+
+void IndexSegment::InitRemovedMarks() {
+    removed_ = make_unique<atomic<uint64_t>[]>((documents_.size() + 63) / 64);
+    removed_term_counts_ = make_unique<atomic<uint32_t>[]>(terms_.size());
+}
+
+void IndexSegment::InitStatusMasks() {
+    for (auto& mask : status_masks_) {
+        mask.assign((documents_.size() + 63) / 64, 0);
+    }
+    for (uint32_t ordinal = 0; ordinal < documents_.size(); ++ordinal) {
+        const size_t status = static_cast<size_t>(documents_.statuses[ordinal]);
+        status_masks_[status][ordinal / 64] |= uint64_t{1} << (ordinal % 64);
+        ++status_counts_[status];
+    }
+}
+
+shared_ptr<const IndexSegment> IndexSegment::Merge(const vector<const IndexSegment*>& segments) {
+    // метки могут ставиться во время слияния, поэтому они копируются один раз в начале;
+    // пустая маска - в сегменте ничего не удалено
+    vector<vector<bool>> removed(segments.size());
+    for (size_t i = 0; i < segments.size(); ++i) {
+        if (segments[i]->removed_count() == 0) {
+            continue;
+        }
+        removed[i].resize(segments[i]->size());
+        for (uint32_t ordinal = 0; ordinal < segments[i]->size(); ++ordinal) {
+            removed[i][ordinal] = segments[i]->IsRemoved(ordinal);
+        }
+    }
+    return Rebuild(segments, removed);
+}
+
+void IndexSegment::MarkRemoved(uint32_t ordinal, const vector<TermId>& terms) const {
+    removed_[ordinal / 64].fetch_or(uint64_t{1} << (ordinal % 64), memory_order_relaxed);
+    for (const TermId term_id : terms) {
+        const auto it = lower_bound(terms_.begin(), terms_.end(), term_id);
+        if (it != terms_.end() && *it == term_id) {
+            removed_term_counts_[it - terms_.begin()].fetch_add(1, memory_order_relaxed);
+        }
+    }
+    removed_count_.fetch_add(1, memory_order_relaxed);
+}
+
+shared_ptr<const IndexSegment> IndexSegment::Rebuild(const vector<const IndexSegment*>& segments,
+                                                     const vector<vector<bool>>& removed) {
+    // новые номера документов: по порядку сегментов, удалённые пропускаются
+    DocumentColumns documents;
+    vector<vector<uint32_t>> new_ordinals(segments.size());
+    vector<uint32_t> offsets(segments.size());
+    for (size_t i = 0; i < segments.size(); ++i) {
+        offsets[i] = static_cast<uint32_t>(documents.size());
+        new_ordinals[i].assign(segments[i]->size(), NO_ORDINAL);
+        for (uint32_t ordinal = 0; ordinal < segments[i]->size(); ++ordinal) {
+            if (removed[i].empty() || !removed[i][ordinal]) {
+                new_ordinals[i][ordinal] = static_cast<uint32_t>(documents.size());
+                documents.push_back(segments[i]->GetDocument(ordinal));
+            }
+        }
+    }
+
+    // слова всех сегментов обходятся слиянием упорядоченных массивов
+    CowArray<TermId> terms;
+    PostingArena postings;
+    PostingList merged;
+    vector<size_t> positions(segments.size(), 0);
+    vector<size_t> sources;   // сегменты, в которых есть текущее слово
+    while (true) {
+        TermId term_id = INVALID_TERM_ID;
+        for (size_t i = 0; i < segments.size(); ++i) {
+            if (positions[i] < segments[i]->terms_.size()) {
+                term_id = min(term_id, segments[i]->terms_[positions[i]]);
+            }
+        }
+        if (term_id == INVALID_TERM_ID) {
+            break;
+        }
+        sources.clear();
+        for (size_t i = 0; i < segments.size(); ++i) {
+            if (positions[i] < segments[i]->terms_.size() && segments[i]->terms_[positions[i]] == term_id) {
+                sources.push_back(i);
+            }
+        }
+        // слово только из одного сегмента, где ничего не удалено: список переносится как есть
+        if (sources.size() == 1 && removed[sources[0]].empty()) {
+            const size_t i = sources[0];
+            terms.push_back(term_id);
+            postings.AppendShifted(segments[i]->postings_[positions[i]], offsets[i]);
+            ++positions[i];
+            continue;
+        }
+        merged.Clear();
+        for (const size_t i : sources) {
+            for (auto it = segments[i]->postings_[positions[i]].begin(); it.IsValid(); it.Next()) {
+                const uint32_t ordinal = new_ordinals[i][it.GetOrdinal()];
+                if (ordinal != NO_ORDINAL) {
+                    merged.Add(ordinal, it.GetCount(), it.GetCount() * 1.0 / documents.lengths[ordinal]);
+                }
+            }
+            ++positions[i];
+        }
+        if (!merged.empty()) {
+            terms.push_back(term_id);
+            postings.Append(merged);
+        }
+    }
+    return make_shared<const IndexSegment>(move(documents), move(terms), move(postings));
+}
+
+uint32_t IndexSegment::FindDocument(int document_id) const {
+    const auto it = lower_bound(id_index_.begin(), id_index_.end(), document_id, [](const IdEntry& entry, int id) {
+        return entry.id < id;
+    });
+    return it != id_index_.end() && it->id == document_id && !IsRemoved(it->ordinal) ? it->ordinal : NO_ORDINAL;
+}
+
+const PostingList* IndexSegment::FindPostings(TermId term_id) const {
+    const auto it = lower_bound(terms_.begin(), terms_.end(), term_id);
+    return it != terms_.end() && *it == term_id ? &postings_[it - terms_.begin()] : nullptr;
+}
+
+size_t IndexSegment::CountDocuments(TermId term_id) const {
+    const auto it = lower_bound(terms_.begin(), terms_.end(), term_id);
+    if (it == terms_.end() || *it != term_id) {
+        return 0;
+    }
+    const size_t position = it - terms_.begin();
+    return postings_[position].size() - removed_term_counts_[position].load(memory_order_relaxed);
+}
+
+// метки удаления не сохраняются: в снимок пишутся сегменты без удалённых документов
+void IndexSegment::WriteTo(SnapshotWriter& writer) const {
+    writer.WriteArray(documents_.ids);
+    writer.WriteArray(documents_.ratings);
+    writer.WriteArray(documents_.statuses);
+    writer.WriteArray(documents_.lengths);
+    writer.WriteArray(id_index_);
+    writer.WriteArray(terms_);
+    for (const PostingList& postings : postings_) {
+        postings.WriteTo(writer);
+    }
+}
+
+shared_ptr<const IndexSegment> IndexSegment::ReadFrom(SnapshotReader& reader) {
+    shared_ptr<IndexSegment> result(new IndexSegment());
+    result->documents_.ids = reader.ReadArray<int>();
+    result->documents_.ratings = reader.ReadArray<int>();
+    result->documents_.statuses = reader.ReadArray<DocumentStatus>();
+    result->documents_.lengths = reader.ReadArray<uint32_t>();
+    result->id_index_ = reader.ReadArray<IdEntry>();
+    result->terms_ = reader.ReadArray<TermId>();
+    const size_t document_count = result->documents_.size();
+    if (result->documents_.ratings.size() != document_count || result->documents_.statuses.size() != document_count
+        || result->documents_.lengths.size() != document_count || result->id_index_.size() != document_count) {
+        throw runtime_error("Snapshot is corrupted"s);
+    }
+    for (const DocumentStatus status : result->documents_.statuses) {
+        if (static_cast<size_t>(status) >= DOCUMENT_STATUS_COUNT) {
+            throw runtime_error("Snapshot is corrupted"s);
+        }
+    }
+    result->postings_.reserve(result->terms_.size());
+    for (size_t i = 0; i < result->terms_.size(); ++i) {
+        result->postings_.push_back(PostingList::ReadFrom(reader));
+    }
+    result->InitRemovedMarks();
+    result->InitStatusMasks();
+    return result;
+}
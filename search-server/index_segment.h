@@ -0,0 +1,171 @@
+#pragma once
+#include "cow_array.h"
+#include "document.h"
+#include "posting_list.h"
+#include "snapshot_io.h"
+#include "term_dictionary.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+const uint32_t NO_ORDINAL = std::numeric_limits<uint32_t>::max();
+
+// Неизменяемая часть индекса: документы с номерами 0..size()-1 внутри сегмента,
+// их данные и списки документов для слов, которые в сегменте встречаются.
+// Созданный сегмент больше не меняется, поэтому его читают из любых потоков без блокировок.
+// Исключение - метки удалённых документов: они ставятся под блокировкой записи
+// и читаются атомарно, а сами документы выбрасываются при слиянии или перестройке.
+class IndexSegment {
+public:
+    struct DocumentInfo {
+        int id;
+        int rating;
+        DocumentStatus status;
+        uint32_t length;   // число слов без стоп-слов
+    };
+
+    // Данные документов по столбцам, i-й элемент каждого массива относится к документу
+    // с номером i: проверка статуса или рейтинга читает один плотный массив.
+    struct DocumentColumns {
+        CowArray<int> ids;
+        CowArray<int> ratings;
+        CowArray<DocumentStatus> statuses;
+        CowArray<uint32_t> lengths;
+
+        void push_back(const DocumentInfo& document);
+
+        size_t size() const {
+            return ids.size();
+        }
+    };
+
+    // в postings i-й список принадлежит слову terms[i], слова упорядочены по возрастанию
+    IndexSegment(DocumentColumns documents, CowArray<TermId> terms, PostingArena postings);
+
+    // Сливает соседние сегменты в один, документы нумеруются заново в том же порядке.
+    // Документы, удалённые к началу слияния, в новый сегмент не попадают.
+    static std::shared_ptr<const IndexSegment> Merge(const std::vector<const IndexSegment*>& segments);
+
+    // число документов вместе с удалёнными
+    size_t size() const {
+        return documents_.size();
+    }
+
+    size_t removed_count() const {
+        return removed_count_.load(std::memory_order_relaxed);
+    }
+
+    size_t live_size() const {
+        return size() - removed_count();
+    }
+
+    bool IsRemoved(uint32_t ordinal) const {
+        return (removed_[ordinal / 64].load(std::memory_order_relaxed) >> (ordinal % 64)) & 1;
+    }
+
+    // terms - слова документа, по ним уменьшается число документов со словом
+    void MarkRemoved(uint32_t ordinal, const std::vector<TermId>& terms) const;
+
+    DocumentInfo GetDocument(uint32_t ordinal) const {
+        return {documents_.ids[ordinal], documents_.ratings[ordinal], documents_.statuses[ordinal], documents_.lengths[ordinal]};
+    }
+
+    int GetId(uint32_t ordinal) const {
+        return documents_.ids[ordinal];
+    }
+
+    int GetRating(uint32_t ordinal) const {
+        return documents_.ratings[ordinal];
+    }
+
+    DocumentStatus GetStatus(uint32_t ordinal) const {
+        return documents_.statuses[ordinal];
+    }
+
+    // число документов со статусом вместе с удалёнными
+    size_t CountStatus(DocumentStatus status) const {
+        return status_counts_[static_cast<size_t>(status)];
+    }
+
+    bool HasStatus(uint32_t ordinal, DocumentStatus status) const {
+        return (status_masks_[static_cast<size_t>(status)][ordinal / 64] >> (ordinal % 64)) & 1;
+    }
+
+    // fn(ordinal) для документов со статусом (и удалённых тоже) с номерами из [first, last)
+    // по возрастанию номеров
+    template <typename Function>
+    void ForEachWithStatus(DocumentStatus status, uint32_t first, uint32_t last, Function fn) const;
+
+    double ComputeTermFreq(uint32_t ordinal, uint32_t count) const {
+        return count * 1.0 / documents_.lengths[ordinal];
+    }
+
+    // NO_ORDINAL, если документа в сегменте нет или он удалён
+    uint32_t FindDocument(int document_id) const;
+
+    // nullptr, если слово в сегменте не встречается; удалённые документы остаются в списке
+    const PostingList* FindPostings(TermId term_id) const;
+
+    // число неудалённых документов со словом
+    size_t CountDocuments(TermId term_id) const;
+
+    bool Contains(TermId term_id, uint32_t ordinal) const {
+        const PostingList* postings = FindPostings(term_id);
+        return postings != nullptr && postings->Contains(ordinal);
+    }
+
+    void WriteTo(SnapshotWriter& writer) const;
+    // массивы сегмента ссылаются на память снимка
+    static std::shared_ptr<const IndexSegment> ReadFrom(SnapshotReader& reader);
+
+private:
+    struct IdEntry {
+        int id;
+        uint32_t ordinal;
+    };
+
+    IndexSegment() = default;
+
+    void InitRemovedMarks();
+    // маски статусов не сохраняются в снимок, а строятся по столбцу статусов
+    void InitStatusMasks();
+
+    static std::shared_ptr<const IndexSegment> Rebuild(const std::vector<const IndexSegment*>& segments,
+                                                       const std::vector<std::vector<bool>>& removed);
+
+    DocumentColumns documents_;
+    CowArray<IdEntry> id_index_;   // по возрастанию id
+    CowArray<TermId> terms_;
+    PostingArena arena_;
+    std::vector<PostingList> postings_;   // ссылаются на arena_ или на память снимка
+    std::unique_ptr<std::atomic<uint64_t>[]> removed_;                // бит на документ
+    std::unique_ptr<std::atomic<uint32_t>[]> removed_term_counts_;   // по позициям terms_
+    mutable std::atomic<uint32_t> removed_count_{0};
+    std::array<std::vector<uint64_t>, DOCUMENT_STATUS_COUNT> status_masks_;   // бит на документ
+    std::array<uint32_t, DOCUMENT_STATUS_COUNT> status_counts_{};
+};
+
+template <typename Function>
+void IndexSegment::ForEachWithStatus(DocumentStatus status, uint32_t first, uint32_t last, Function fn) const {
+    const std::vector<uint64_t>& mask = status_masks_[static_cast<size_t>(status)];
+    last = std::min<uint32_t>(last, static_cast<uint32_t>(size()));
+    if (first >= last) {
+        return;
+    }
+    for (size_t i = first / 64; i <= (last - 1) / 64; ++i) {
+        uint64_t bits = mask[i];
+        if (i == first / 64) {
+            bits &= ~uint64_t{0} << (first % 64);
+        }
+        if (i == (last - 1) / 64 && last % 64 != 0) {
+            bits &= (uint64_t{1} << (last % 64)) - 1;
+        }
+        for (; bits != 0; bits &= bits - 1) {
+            fn(static_cast<uint32_t>(i * 64 + __builtin_ctzll(bits)));
+        }
+    }
+}
@@ -147,6 +147,7 @@ int main() {
 
 #include "process_queries.h"
 #include "search_server.h"
+#include "test_example_functions.h"
 #include <execution>
 #include <iostream>
 #include <string>
@@ -159,6 +160,7 @@ void PrintDocument(const Document& document) {
          << "rating = "s << document.rating << " }"s << endl;
 }
 int main() {
+    TestSearchServer();
     SearchServer search_server("and with"s);
     int id = 0;
     for (
@@ -0,0 +1,221 @@
+#include "near_duplicates.h"
+#include "search_server.h"
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <stdexcept>
+using namespace std;
+
+namespace {
+
+// перемешивание битов из MurmurHash3
+uint64_t MixBits(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDull;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53ull;
+    value ^= value >> 33;
+    return value;
+}
+
+} // namespace
+
+double ComputeJaccard(DocumentTerms lhs, DocumentTerms rhs) {
+    if (lhs.empty() && rhs.empty()) {
+        return 1.0;
+    }
+    size_t common = 0;
+    const TermFrequency* left = lhs.begin();
+    const TermFrequency* right = rhs.begin();
+    while (left != lhs.end() && right != rhs.end()) {
+        if (left->term_id < right->term_id) {
+            ++left;
+        } else if (right->term_id < left->term_id) {
+            ++right;
+        } else {
+            ++common;
+            ++left;
+            ++right;
+        }
+    }
+    return common * 1.0 / (lhs.size() + rhs.size() - common);
+}
+
+NearDuplicateIndex::NearDuplicateIndex(const SearchServer& search_server, const NearDuplicateOptions& options)
+    : search_server_(search_server)
+    , options_(options)
+    , bands_(options.band_count) {
+    if (options.band_count == 0 || options.rows_per_band == 0) {
+        throw invalid_argument("Signature must not be empty"s);
+    }
+    if (!(options.jaccard_threshold > 0.0 && options.jaccard_threshold <= 1.0)) {
+        throw invalid_argument("Jaccard threshold must be in (0, 1]"s);
+    }
+    // коэффициенты постоянны, поэтому подписи одного документа в разных индексах равны
+    uint64_t seed = 0x9E3779B97F4A7C15ull;
+    for (size_t i = 0; i < options.band_count * options.rows_per_band; ++i) {
+        multipliers_.push_back(MixBits(seed += 0x9E3779B97F4A7C15ull) | 1);
+        increments_.push_back(MixBits(seed += 0x9E3779B97F4A7C15ull));
+    }
+}
+
+vector<int> NearDuplicateIndex::FindSimilar(int document_id) const {
+    const DocumentTerms terms = search_server_.GetDocumentTerms(document_id);
+    vector<uint64_t> band_keys(options_.band_count);
+    NearDuplicateIndex::ComputeBandKeys(terms, band_keys.data());
+    vector<int> result = NearDuplicateIndex::FindSimilar(terms, band_keys.data());
+    result.erase(remove(result.begin(), result.end(), document_id), result.end());
+    return result;
+}
+
+vector<int> NearDuplicateIndex::Add(int document_id) {
+    if (NearDuplicateIndex::Contains(document_id)) {
+        throw invalid_argument("Document is already indexed"s);
+    }
+    const DocumentTerms terms = search_server_.GetDocumentTerms(document_id);
+    vector<uint64_t> band_keys(options_.band_count);
+    NearDuplicateIndex::ComputeBandKeys(terms, band_keys.data());
+    vector<int> result = NearDuplicateIndex::FindSimilar(terms, band_keys.data());
+    NearDuplicateIndex::Insert(document_id, band_keys.data());
+    return result;
+}
+
+void NearDuplicateIndex::AddDocuments(const vector<int>& document_ids) {
+    for (const int document_id : document_ids) {
+        if (NearDuplicateIndex::Contains(document_id)) {
+            throw invalid_argument("Document is already indexed"s);
+        }
+    }
+    vector<DocumentTerms> terms;
+    vector<uint64_t> band_keys;
+    NearDuplicateIndex::ComputeBandKeys(document_ids, terms, band_keys);
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        NearDuplicateIndex::Insert(document_ids[i], band_keys.data() + i * options_.band_count);
+    }
+}
+
+void NearDuplicateIndex::Remove(int document_id) {
+    const auto it = slots_.find(document_id);
+    if (it == slots_.end()) {
+        return;
+    }
+    const uint64_t* band_keys = band_keys_.data() + it->second * options_.band_count;
+    for (size_t band = 0; band < options_.band_count; ++band) {
+        const auto bucket = bands_[band].find(band_keys[band]);
+        vector<int>& documents = bucket->second;
+        *find(documents.begin(), documents.end(), document_id) = documents.back();
+        documents.pop_back();
+        if (documents.empty()) {
+            bands_[band].erase(bucket);
+        }
+    }
+    free_slots_.push_back(it->second);
+    slots_.erase(it);
+}
+
+vector<NearDuplicateGroup> NearDuplicateIndex::GroupDocuments() {
+    vector<int> document_ids;
+    for (const int document_id : search_server_) {
+        if (!NearDuplicateIndex::Contains(document_id)) {
+            document_ids.push_back(document_id);
+        }
+    }
+    vector<DocumentTerms> terms;
+    vector<uint64_t> band_keys;
+    NearDuplicateIndex::ComputeBandKeys(document_ids, terms, band_keys);
+    // В индекс попадают только документы, не похожие на уже добавленные, поэтому копии одного
+    // документа не накапливаются в общих полосах и каждый следующий сверяется с одним-двумя.
+    map<int, vector<int>> groups;
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        const uint64_t* document_keys = band_keys.data() + i * options_.band_count;
+        const vector<int> similar = NearDuplicateIndex::FindSimilar(terms[i], document_keys);
+        if (similar.empty()) {
+            NearDuplicateIndex::Insert(document_ids[i], document_keys);
+        } else {
+            groups[similar.front()].push_back(document_ids[i]);
+        }
+    }
+    vector<NearDuplicateGroup> result;
+    result.reserve(groups.size());
+    for (auto& [document_id, duplicates] : groups) {
+        result.push_back({document_id, move(duplicates)});
+    }
+    return result;
+}
+
+void NearDuplicateIndex::ComputeBandKeys(DocumentTerms terms, uint64_t* band_keys) const {
+    thread_local vector<uint32_t> minimums;
+    minimums.assign(multipliers_.size(), numeric_limits<uint32_t>::max());
+    for (const TermFrequency& term : terms) {
+        // один хеш слова, из него все функции подписи умножением со сдвигом
+        const uint64_t hash = MixBits(term.term_id);
+        for (size_t i = 0; i < minimums.size(); ++i) {
+            minimums[i] = min(minimums[i], static_cast<uint32_t>((multipliers_[i] * hash + increments_[i]) >> 32));
+        }
+    }
+    for (size_t band = 0; band < options_.band_count; ++band) {
+        uint64_t key = band;
+        for (size_t row = 0; row < options_.rows_per_band; ++row) {
+            key = MixBits(key ^ minimums[band * options_.rows_per_band + row]) + row;
+        }
+        band_keys[band] = key;
+    }
+}
+
+void NearDuplicateIndex::ComputeBandKeys(const vector<int>& document_ids, vector<DocumentTerms>& terms, vector<uint64_t>& band_keys) const {
+    // подписи - основная работа, они не зависят друг от друга
+    terms.assign(document_ids.size(), DocumentTerms());
+    band_keys.assign(document_ids.size() * options_.band_count, 0);
+    search_server_.GetThreadPool()->ParallelFor(document_ids.size(), 0, [&](size_t i) {
+        terms[i] = search_server_.GetDocumentTerms(document_ids[i]);
+        NearDuplicateIndex::ComputeBandKeys(terms[i], band_keys.data() + i * options_.band_count);
+    });
+}
+
+vector<int> NearDuplicateIndex::FindSimilar(DocumentTerms terms, const uint64_t* band_keys) const {
+    vector<int> candidates;
+    for (size_t band = 0; band < options_.band_count; ++band) {
+        const auto bucket = bands_[band].find(band_keys[band]);
+        if (bucket != bands_[band].end()) {
+            candidates.insert(candidates.end(), bucket->second.begin(), bucket->second.end());
+        }
+    }
+    sort(candidates.begin(), candidates.end());
+    candidates.erase(unique(candidates.begin(), candidates.end()), candidates.end());
+    candidates.erase(remove_if(candidates.begin(), candidates.end(), [this, terms](int candidate) {
+        return ComputeJaccard(search_server_.GetDocumentTerms(candidate), terms) < options_.jaccard_threshold;
+    }), candidates.end());
+    return candidates;
+}
+
+void NearDuplicateIndex::Insert(int document_id, const uint64_t* band_keys) {
+    size_t slot = band_keys_.size() / options_.band_count;
+    if (free_slots_.empty()) {
+        band_keys_.resize(band_keys_.size() + options_.band_count);
+    } else {
+        slot = free_slots_.back();
+        free_slots_.pop_back();
+    }
+    copy(band_keys, band_keys + options_.band_count, band_keys_.data() + slot * options_.band_count);
+    slots_.emplace(document_id, slot);
+    for (size_t band = 0; band < options_.band_count; ++band) {
+        bands_[band][band_keys[band]].push_back(document_id);
+    }
+}
+
+vector<NearDuplicateGroup> FindNearDuplicates(const SearchServer& search_server, const NearDuplicateOptions& options) {
+    NearDuplicateIndex index(search_server, options);
+    return index.GroupDocuments();
+}
+
+void RemoveNearDuplicates(SearchServer& search_server, const NearDuplicateOptions& options) {
+    vector<int> id_to_remove;
+    for (const NearDuplicateGroup& group : FindNearDuplicates(search_server, options)) {
+        id_to_remove.insert(id_to_remove.end(), group.duplicates.begin(), group.duplicates.end());
+    }
+    sort(id_to_remove.begin(), id_to_remove.end());
+    for (const int id : id_to_remove) {
+        cout << "Found near-duplicate document id "s << id << "\n"s;
+        search_server.RemoveDocument(id);
+    }
+}
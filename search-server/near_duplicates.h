@@ -0,0 +1,89 @@
+#pragma once
+#include "forward_index.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+class SearchServer;
+
+// Подпись документа - band_count * rows_per_band минимальных хешей его набора слов.
+// Документы-кандидаты совпадают хотя бы в одной полосе из rows_per_band хешей, и для
+// них считается точный коэффициент Жаккара по прямому индексу сервера.
+struct NearDuplicateOptions {
+    size_t band_count = 16;
+    size_t rows_per_band = 4;
+    // похожие - документы с коэффициентом Жаккара наборов слов не меньше порога
+    double jaccard_threshold = 0.8;
+};
+
+// документ с меньшим id и документы, похожие на него
+struct NearDuplicateGroup {
+    int document_id = 0;
+    std::vector<int> duplicates;
+};
+
+// Индекс подписей документов сервера (MinHash с LSH-полосами). Слова документов берутся
+// у сервера, поэтому документ нужно убрать из индекса до удаления с сервера.
+// Синхронизацию обеспечивает владелец. Индекс, который поддерживает сам сервер, включается
+// SearchServer::EnableNearDuplicateIndex.
+class NearDuplicateIndex {
+public:
+    explicit NearDuplicateIndex(const SearchServer& search_server, const NearDuplicateOptions& options = NearDuplicateOptions());
+
+    // документы индекса, похожие на документ сервера, по возрастанию id
+    std::vector<int> FindSimilar(int document_id) const;
+
+    // добавляет документ сервера и возвращает то же, что FindSimilar до добавления
+    std::vector<int> Add(int document_id);
+
+    // добавляет документы сервера, не ища похожих; подписи считаются параллельно на пуле сервера
+    void AddDocuments(const std::vector<int>& document_ids);
+
+    void Remove(int document_id);
+
+    // Документы сервера, которых нет в индексе, по возрастанию id: подписи считаются
+    // параллельно на пуле сервера, затем документ, похожий на документ индекса, попадает
+    // в группу к тому, у которого меньше id, а непохожий добавляется в индекс.
+    // Возвращает только группы с дубликатами, по возрастанию id.
+    std::vector<NearDuplicateGroup> GroupDocuments();
+
+    bool Contains(int document_id) const {
+        return slots_.count(document_id) > 0;
+    }
+
+    size_t size() const {
+        return slots_.size();
+    }
+
+private:
+    // ключи полос документа: band_count значений подряд
+    void ComputeBandKeys(DocumentTerms terms, uint64_t* band_keys) const;
+    // слова и ключи полос документов сервера, параллельно
+    void ComputeBandKeys(const std::vector<int>& document_ids, std::vector<DocumentTerms>& terms,
+                         std::vector<uint64_t>& band_keys) const;
+
+    std::vector<int> FindSimilar(DocumentTerms terms, const uint64_t* band_keys) const;
+
+    void Insert(int document_id, const uint64_t* band_keys);
+
+    const SearchServer& search_server_;
+    NearDuplicateOptions options_;
+    // коэффициенты хеш-функций a * x + b, a нечётные
+    std::vector<uint64_t> multipliers_;
+    std::vector<uint64_t> increments_;
+    // полоса -> ключ полосы -> документы
+    std::vector<std::unordered_map<uint64_t, std::vector<int>>> bands_;
+    // ключи полос документов лежат подряд, место удалённого занимает следующий добавленный
+    std::unordered_map<int, size_t> slots_;
+    std::vector<uint64_t> band_keys_;
+    std::vector<size_t> free_slots_;
+};
+
+// коэффициент Жаккара наборов слов; у двух пустых наборов - 1
+double ComputeJaccard(DocumentTerms lhs, DocumentTerms rhs);
+
+std::vector<NearDuplicateGroup> FindNearDuplicates(const SearchServer& search_server,
+                                                   const NearDuplicateOptions& options = NearDuplicateOptions());
+
+// оставляет из каждой группы документ с меньшим id
+void RemoveNearDuplicates(SearchServer& search_server, const NearDuplicateOptions& options = NearDuplicateOptions());
@@ -0,0 +1,177 @@
+#include "posting_list.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+using namespace std;
+
+namespace {
+
+template <typename Bytes>
+void WriteVarint(Bytes& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+uint32_t ReadVarint(const uint8_t*& in) {
+    uint32_t value = 0;
+    for (int shift = 0;; shift += 7) {
+        const uint8_t byte = *in++;
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if (byte < 0x80) {
+            return value;
+        }
+    }
+}
+
+float RoundUp(double value) {
+    float result = static_cast<float>(value);
+    if (result < value) {
+        result = nextafter(result, numeric_limits<float>::infinity());
+    }
+    return result;
+}
+
+} // namespace
+
+void PostingList::Add(uint32_t ordinal, uint32_t count, double term_freq) {
+    const float term_freq_bound = RoundUp(term_freq);
+    if (size_ % POSTING_BLOCK_SIZE == 0) {
+        const uint32_t base = blocks_.empty() ? 0 : blocks_.back().last_ordinal;
+        blocks_.push_back({ordinal, static_cast<uint32_t>(ordinal_bytes_.size()), static_cast<uint32_t>(count_bytes_.size()), term_freq_bound});
+        WriteVarint(ordinal_bytes_, ordinal - base);
+    } else {
+        Block& block = blocks_.MutableBack();
+        WriteVarint(ordinal_bytes_, ordinal - block.last_ordinal);
+        block.last_ordinal = ordinal;
+        block.max_term_freq = max(block.max_term_freq, term_freq_bound);
+    }
+    max_term_freq_ = max<double>(max_term_freq_, term_freq_bound);
+    WriteVarint(count_bytes_, count);
+    ++size_;
+}
+
+void PostingList::Clear() {
+    ordinal_bytes_.clear();
+    count_bytes_.clear();
+    blocks_.clear();
+    size_ = 0;
+    max_term_freq_ = 0.0;
+}
+
+bool PostingList::Contains(uint32_t ordinal) const {
+    auto it = begin();
+    it.SkipTo(ordinal);
+    return it.IsValid() && it.GetOrdinal() == ordinal;
+}
+
+PostingList::Iterator PostingList::begin() const {
+    return Iterator(*this);
+}
+
+size_t PostingList::MemoryUsage() const {
+    return sizeof(*this) + ordinal_bytes_.MemoryUsage() + count_bytes_.MemoryUsage() + blocks_.MemoryUsage();
+}
+
+void PostingList::WriteTo(SnapshotWriter& writer) const {
+    writer.WriteValue(size_);
+    writer.WriteValue(max_term_freq_);
+    writer.WriteArray(blocks_);
+    writer.WriteArray(ordinal_bytes_);
+    writer.WriteArray(count_bytes_);
+}
+
+PostingList PostingList::ReadFrom(SnapshotReader& reader) {
+    PostingList result;
+    result.size_ = reader.ReadValue<uint32_t>();
+    result.max_term_freq_ = reader.ReadValue<double>();
+    result.blocks_ = reader.ReadArray<Block>();
+    result.ordinal_bytes_ = reader.ReadArray<uint8_t>();
+    result.count_bytes_ = reader.ReadArray<uint8_t>();
+    return result;
+}
+
+void PostingArena::Append(const PostingList& list) {
+    entries_.push_back({ordinal_bytes_.size(), list.ordinal_bytes_.size(), count_bytes_.size(), list.count_bytes_.size(),
+                        blocks_.size(), list.blocks_.size(), list.size_, list.max_term_freq_});
+    ordinal_bytes_.insert(ordinal_bytes_.end(), list.ordinal_bytes_.begin(), list.ordinal_bytes_.end());
+    count_bytes_.insert(count_bytes_.end(), list.count_bytes_.begin(), list.count_bytes_.end());
+    blocks_.insert(blocks_.end(), list.blocks_.begin(), list.blocks_.end());
+}
+
+void PostingArena::AppendShifted(const PostingList& list, uint32_t offset) {
+    // целиком хранится только первый номер списка, остальные - разностями,
+    // поэтому перекодируется одно число, а смещения следующих блоков сдвигаются на разницу длин
+    const uint8_t* in = list.ordinal_bytes_.data();
+    const uint32_t first_ordinal = ReadVarint(in);
+    const size_t old_length = in - list.ordinal_bytes_.data();
+    const size_t ordinals_offset = ordinal_bytes_.size();
+    WriteVarint(ordinal_bytes_, first_ordinal + offset);
+    const size_t new_length = ordinal_bytes_.size() - ordinals_offset;
+    ordinal_bytes_.insert(ordinal_bytes_.end(), in, list.ordinal_bytes_.end());
+    entries_.push_back({ordinals_offset, ordinal_bytes_.size() - ordinals_offset, count_bytes_.size(), list.count_bytes_.size(),
+                        blocks_.size(), list.blocks_.size(), list.size_, list.max_term_freq_});
+    count_bytes_.insert(count_bytes_.end(), list.count_bytes_.begin(), list.count_bytes_.end());
+    for (size_t i = 0; i < list.blocks_.size(); ++i) {
+        PostingList::Block block = list.blocks_[i];
+        block.last_ordinal += offset;
+        if (i > 0) {
+            block.ordinals_offset = static_cast<uint32_t>(block.ordinals_offset + new_length - old_length);
+        }
+        blocks_.push_back(block);
+    }
+}
+
+vector<PostingList> PostingArena::GetLists() const {
+    vector<PostingList> lists(entries_.size());
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        const Entry& entry = entries_[i];
+        lists[i].ordinal_bytes_ = CowArray<uint8_t>::View(ordinal_bytes_.data() + entry.ordinals_offset, entry.ordinals_size);
+        lists[i].count_bytes_ = CowArray<uint8_t>::View(count_bytes_.data() + entry.counts_offset, entry.counts_size);
+        lists[i].blocks_ = CowArray<PostingList::Block>::View(blocks_.data() + entry.blocks_offset, entry.blocks_size);
+        lists[i].size_ = entry.size;
+        lists[i].max_term_freq_ = entry.max_term_freq;
+    }
+    return lists;
+}
+
+PostingList::Iterator::Iterator(const PostingList& list)
+    : list_(&list) {
+    DecodeBlock(0);
+}
+
+void PostingList::Iterator::SkipTo(uint32_t ordinal) {
+    if (!IsValid() || ordinals_[block_size_ - 1] < ordinal) {
+        const auto& blocks = list_->blocks_;
+        const auto next = lower_bound(blocks.begin() + min(block_ + 1, blocks.size()), blocks.end(), ordinal,
+                                      [](const Block& block, uint32_t value) {
+                                          return block.last_ordinal < value;
+                                      });
+        DecodeBlock(next - blocks.begin());
+        if (!IsValid()) {
+            return;
+        }
+    }
+    pos_ = lower_bound(ordinals_.begin() + pos_, ordinals_.begin() + block_size_, ordinal) - ordinals_.begin();
+}
+
+void PostingList::Iterator::DecodeBlock(size_t block) {
+    block_ = block;
+    pos_ = 0;
+    if (block >= list_->blocks_.size()) {
+        block_size_ = 0;
+        return;
+    }
+    block_size_ = min<size_t>(POSTING_BLOCK_SIZE, list_->size_ - block * POSTING_BLOCK_SIZE);
+    const uint8_t* ordinal_in = list_->ordinal_bytes_.data() + list_->blocks_[block].ordinals_offset;
+    const uint8_t* count_in = list_->count_bytes_.data() + list_->blocks_[block].counts_offset;
+    uint32_t ordinal = block == 0 ? 0 : list_->blocks_[block - 1].last_ordinal;
+    for (size_t i = 0; i < block_size_; ++i) {
+        ordinal += ReadVarint(ordinal_in);
+        ordinals_[i] = ordinal;
+        counts_[i] = ReadVarint(count_in);
+    }
+}
@@ -0,0 +1,142 @@
+#pragma once
+#include "cow_array.h"
+#include "snapshot_io.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+const size_t POSTING_BLOCK_SIZE = 128;
+
+// Список документов одного слова в сегменте. Документы адресуются номерами внутри
+// сегмента (ordinal), которые выдаются по возрастанию, поэтому новый документ
+// всегда дописывается в конец.
+// Номера хранятся разностями в varint, число вхождений слова — отдельным
+// varint-потоком. Каждые POSTING_BLOCK_SIZE записей образуют блок, который
+// декодируется целиком и может быть пропущен по last_ordinal.
+// Для динамического отсечения (WAND) список хранит верхнюю оценку TF по каждому
+// блоку и по всему списку.
+class PostingList {
+public:
+    class Iterator;
+
+    void Add(uint32_t ordinal, uint32_t count, double term_freq);
+
+    // список снова пуст, но память остаётся для следующего
+    void Clear();
+
+    bool Contains(uint32_t ordinal) const;
+
+    Iterator begin() const;
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    double GetMaxTermFreq() const {
+        return max_term_freq_;
+    }
+
+    size_t MemoryUsage() const;
+
+    void WriteTo(SnapshotWriter& writer) const;
+    // список ссылается на память снимка до первого изменения
+    static PostingList ReadFrom(SnapshotReader& reader);
+
+private:
+    friend class PostingArena;
+
+    struct Block {
+        uint32_t last_ordinal;
+        uint32_t ordinals_offset;
+        uint32_t counts_offset;
+        float max_term_freq;   // округлено вверх
+    };
+
+    CowArray<uint8_t> ordinal_bytes_;
+    CowArray<uint8_t> count_bytes_;
+    CowArray<Block> blocks_;
+    uint32_t size_ = 0;
+    double max_term_freq_ = 0.0;
+};
+
+// Общая память для списков одного сегмента. Списки копируются сюда подряд, а сегмент
+// хранит ссылающиеся на неё PostingList, так что на каждое слово не приходится
+// отдельных выделений памяти. Список для Append удобно собирать в одном и том же
+// объекте, вызывая Clear между словами.
+class PostingArena {
+public:
+    void Append(const PostingList& list);
+    // тот же список, но номера документов больше на offset; байты копируются без перекодирования
+    void AppendShifted(const PostingList& list, uint32_t offset);
+
+    // Списки ссылаются на память арены: после вызова арену нельзя менять,
+    // а перемещать можно (буферы векторов при перемещении остаются на месте).
+    std::vector<PostingList> GetLists() const;
+
+private:
+    struct Entry {
+        size_t ordinals_offset;
+        size_t ordinals_size;
+        size_t counts_offset;
+        size_t counts_size;
+        size_t blocks_offset;
+        size_t blocks_size;
+        uint32_t size;
+        double max_term_freq;
+    };
+
+    std::vector<uint8_t> ordinal_bytes_;
+    std::vector<uint8_t> count_bytes_;
+    std::vector<PostingList::Block> blocks_;
+    std::vector<Entry> entries_;
+};
+
+class PostingList::Iterator {
+public:
+    explicit Iterator(const PostingList& list);
+
+    bool IsValid() const {
+        return pos_ < block_size_;
+    }
+
+    uint32_t GetOrdinal() const {
+        return ordinals_[pos_];
+    }
+
+    uint32_t GetCount() const {
+        return counts_[pos_];
+    }
+
+    void Next() {
+        if (++pos_ == block_size_) {
+            DecodeBlock(block_ + 1);
+        }
+    }
+
+    // переходит к первому документу с номером не меньше ordinal
+    void SkipTo(uint32_t ordinal);
+
+    // оценки текущего блока: ни один документ блока не имеет TF больше GetBlockMaxTermFreq()
+    uint32_t GetBlockLastOrdinal() const {
+        return list_->blocks_[block_].last_ordinal;
+    }
+
+    double GetBlockMaxTermFreq() const {
+        return list_->blocks_[block_].max_term_freq;
+    }
+
+private:
+    void DecodeBlock(size_t block);
+
+    const PostingList* list_;
+    size_t block_ = 0;
+    size_t pos_ = 0;
+    size_t block_size_ = 0;
+    std::array<uint32_t, POSTING_BLOCK_SIZE> ordinals_;
+    std::array<uint32_t, POSTING_BLOCK_SIZE> counts_;
+};
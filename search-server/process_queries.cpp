@@ -1,6 +1,10 @@
 #include "process_queries.h"
+#include "thread_pool.h"
 #include <algorithm>
-#include <execution>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <numeric>
 #include <utility>
 
 
@@ -8,19 +12,124 @@ std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries){
   std::vector<std::vector<Document>> result(queries.size()); 
-    std::transform(std::execution::par,queries.begin(),queries.end(),result.begin(),[&search_server](auto query){return search_server.FindTopDocuments(query);});
+    search_server.GetThreadPool()->ParallelFor(queries.size(), 1, [&search_server, &queries, &result](size_t i) {
+        result[i] = search_server.FindTopDocuments(queries[i]);
+    });
     return result;
 } 
 
 std::vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
     const std::vector<std::string>& queries){
-    std::vector<Document> result;
-    for (auto doc : ProcessQueries(search_server,queries)){
-            for (auto doc2 : doc){
-                result.push_back(std::move(doc2));
-            }
-        
+    return ProcessQueriesFlat(search_server, queries).documents;
+} 
+
+JoinedDocuments ProcessQueriesFlat(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries) {
+    using namespace std;
+    // у каждого запроса ячейка на top_k документов, в offsets[i + 1] - сколько найдено
+    const SearchOptions options;
+    JoinedDocuments result;
+    result.documents.resize(queries.size() * options.top_k);
+    result.offsets.assign(queries.size() + 1, 0);
+    search_server.GetThreadPool()->ParallelFor(queries.size(), 1, [&search_server, &queries, &options, &result](size_t index) {
+        // через кэш выдачи, как ProcessQueries, но без вектора на каждый запрос
+        thread_local vector<Document> buffer;
+        search_server.FindTopDocuments(queries[index], options, buffer);
+        copy(buffer.begin(), buffer.end(), result.documents.begin() + index * options.top_k);
+        result.offsets[index + 1] = buffer.size();
+    });
+    inclusive_scan(result.offsets.begin(), result.offsets.end(), result.offsets.begin());
+    // offsets[i] <= i * top_k, поэтому ячейки сдвигаются к началу по порядку без перекрытия с непрочитанными
+    for (size_t i = 0; i < queries.size(); ++i) {
+        const auto cell = result.documents.begin() + i * options.top_k;
+        move(cell, cell + (result.offsets[i + 1] - result.offsets[i]), result.documents.begin() + result.offsets[i]);
     }
+    result.documents.resize(result.offsets.back());
     return result;
-} 
\ No newline at end of file
+}
+
+void ProcessQueriesStream(
+    const SearchServer& search_server,
+    const std::function<bool(std::string&)>& next_query,
+    const std::function<void(const std::vector<Document>&)>& output,
+    const QueryStreamOptions& options) {
+    using namespace std;
+    // Окно - кольцо ячеек: вызывающий поток читает запросы в свободные ячейки, пул ищет,
+    // а выдача забирается из ячеек строго по порядку. Строки и буферы ячеек переиспользуются.
+    struct Slot {
+        string query;
+        vector<Document> documents;
+        exception_ptr error;
+        bool done = false;
+    };
+    const auto pool = options.thread_count > 0 ? make_shared<ThreadPool>(options.thread_count) : search_server.GetThreadPool();
+    const size_t window = options.window > 0 ? options.window : 4 * pool->GetThreadCount();
+    vector<Slot> slots(window);
+    mutex done_mutex;
+    condition_variable done_condition;
+
+    // пока запрос не готов, вызывающий поток помогает пулу
+    const auto wait = [&pool, &done_mutex, &done_condition](Slot& slot) {
+        while (true) {
+            {
+                lock_guard guard(done_mutex);
+                if (slot.done) {
+                    return;
+                }
+            }
+            if (!pool->RunPendingTask()) {
+                unique_lock lock(done_mutex);
+                done_condition.wait(lock, [&slot] {
+                    return slot.done;
+                });
+                return;
+            }
+        }
+    };
+
+    size_t submitted = 0;
+    size_t emitted = 0;
+    bool input_done = false;
+    try {
+        while (true) {
+            while (!input_done && submitted - emitted < window) {
+                Slot& slot = slots[submitted % window];
+                if (!next_query(slot.query)) {
+                    input_done = true;
+                    break;
+                }
+                slot.done = false;
+                slot.error = nullptr;
+                pool->Submit([&search_server, &slot, &done_mutex, &done_condition] {
+                    try {
+                        slot.documents = search_server.FindTopDocuments(slot.query);
+                    } catch (...) {
+                        slot.error = current_exception();
+                    }
+                    lock_guard guard(done_mutex);
+                    slot.done = true;
+                    done_condition.notify_one();
+                });
+                ++submitted;
+            }
+            if (emitted == submitted) {
+                return;
+            }
+            Slot& slot = slots[emitted % window];
+            wait(slot);
+            if (slot.error) {
+                rethrow_exception(slot.error);
+            }
+            output(slot.documents);
+            ++emitted;
+        }
+    } catch (...) {
+        // задачи ссылаются на ячейки: прежде чем выйти, нужно дождаться начатых
+        for (size_t i = emitted; i < submitted; ++i) {
+            wait(slots[i % window]);
+        }
+        throw;
+    }
+}
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <functional>
+#include <iterator>
 #include <vector>
 #include <string>
+#include <type_traits>
 #include "search_server.h"
 #include "document.h"
 
@@ -11,4 +14,63 @@ std::vector<std::vector<Document>> ProcessQueries(
 
 std::vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
-    const std::vector<std::string>& queries); 
\ No newline at end of file
+    const std::vector<std::string>& queries); 
+
+// Выдача всех запросов подряд в одном массиве: выдача i-го запроса -
+// documents[offsets[i], offsets[i + 1]), offsets.size() == число запросов + 1.
+struct JoinedDocuments {
+    std::vector<Document> documents;
+    std::vector<size_t> offsets;
+};
+
+// Запросы выполняются параллельно так же, как в ProcessQueries (через кэш выдачи, если он
+// включён), каждый пишет выдачу в свою ячейку заранее выделенного массива, затем смещения
+// считаются префиксной суммой и ячейки сдвигаются на место.
+JoinedDocuments ProcessQueriesFlat(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries);
+
+struct QueryStreamOptions {
+    size_t thread_count = 0;   // 0 - пул сервера, иначе свой пул из thread_count потоков
+    size_t window = 0;         // запросов в работе одновременно; 0 - по 4 на поток
+};
+
+// Потоковый ProcessQueries: next_query кладёт в строку следующий запрос или возвращает false,
+// output получает выдачу каждого запроса в порядке запросов. Следующий запрос читается,
+// только когда в окне есть место, поэтому память не зависит от длины потока.
+// Буфер выдачи, переданный в output, после возврата переиспользуется.
+// Если запрос неверный, выбрасывается его исключение; выдачу предыдущих output уже получил.
+void ProcessQueriesStream(
+    const SearchServer& search_server,
+    const std::function<bool(std::string&)>& next_query,
+    const std::function<void(const std::vector<Document>&)>& output,
+    const QueryStreamOptions& options = QueryStreamOptions());
+
+// То же для запросов из [first, last). output - функция от const std::vector<Document>&
+// или итератор вывода, в который пишутся копии выдачи.
+template <typename InputIt, typename Output>
+void ProcessQueriesStream(
+    const SearchServer& search_server,
+    InputIt first, InputIt last,
+    Output output,
+    const QueryStreamOptions& options = QueryStreamOptions());
+
+template <typename InputIt, typename Output>
+void ProcessQueriesStream(const SearchServer& search_server, InputIt first, InputIt last, Output output, const QueryStreamOptions& options) {
+    const auto next_query = [&first, &last](std::string& query) {
+        if (first == last) {
+            return false;
+        }
+        query = *first;
+        ++first;
+        return true;
+    };
+    if constexpr (std::is_invocable_v<Output&, const std::vector<Document>&>) {
+        ProcessQueriesStream(search_server, next_query, std::ref(output), options);
+    } else {
+        ProcessQueriesStream(search_server, next_query, [&output](const std::vector<Document>& documents) {
+            *output = documents;
+            ++output;
+        }, options);
+    }
+}
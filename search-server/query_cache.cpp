@@ -0,0 +1,122 @@
+#include "query_cache.h"
+#include <utility>
+using namespace std;
+
+namespace {
+
+// примерная стоимость узла списка и узла хеш-таблицы
+const size_t ENTRY_OVERHEAD = 64;
+
+size_t ComputeBytes(const QueryCacheKey& key, const vector<Document>& documents) {
+    return sizeof(QueryCacheKey) + sizeof(documents) + ENTRY_OVERHEAD
+        + (key.plus_words.size() + key.minus_words.size()) * sizeof(TermId) + documents.size() * sizeof(Document);
+}
+
+} // namespace
+
+bool QueryCacheKey::operator==(const QueryCacheKey& other) const {
+    return status == other.status && top_k == other.top_k && offset == other.offset
+        && plus_words == other.plus_words && minus_words == other.minus_words;
+}
+
+size_t QueryCacheKeyHash::operator()(const QueryCacheKey& key) const {
+    uint64_t hash = 0x9E3779B97F4A7C15ull;
+    const auto mix = [&hash](uint64_t value) {
+        hash = (hash ^ value) * 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 32;
+    };
+    for (const TermId word : key.plus_words) {
+        mix(word);
+    }
+    // разделитель, чтобы слово не могло перейти из плюс-слов в минус-слова с тем же хешем
+    mix(key.plus_words.size());
+    for (const TermId word : key.minus_words) {
+        mix(word);
+    }
+    mix(static_cast<uint64_t>(key.status));
+    mix(key.top_k);
+    mix(key.offset);
+    return static_cast<size_t>(hash);
+}
+
+QueryCache::QueryCache()
+    : shards_(SHARD_COUNT) {
+}
+
+void QueryCache::SetByteBudget(size_t byte_budget) {
+    byte_budget_.store(byte_budget, memory_order_relaxed);
+    for (Shard& shard : shards_) {
+        lock_guard guard(shard.mutex);
+        Evict(shard, byte_budget / SHARD_COUNT);
+    }
+}
+
+bool QueryCache::Find(const QueryCacheKey& key, uint64_t epoch, vector<Document>& documents) {
+    Shard& shard = GetShard(key);
+    {
+        lock_guard guard(shard.mutex);
+        const auto it = shard.entries.find(key);
+        if (it != shard.entries.end()) {
+            if (it->second.epoch == epoch) {
+                shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru_position);
+                hits_.fetch_add(1, memory_order_relaxed);
+                documents = it->second.documents;
+                return true;
+            }
+            Erase(shard, it);
+        }
+    }
+    misses_.fetch_add(1, memory_order_relaxed);
+    return false;
+}
+
+void QueryCache::Insert(QueryCacheKey key, uint64_t epoch, vector<Document> documents) {
+    const size_t budget = byte_budget_.load(memory_order_relaxed) / SHARD_COUNT;
+    const size_t bytes = ComputeBytes(key, documents);
+    if (bytes > budget) {
+        return;
+    }
+    Shard& shard = GetShard(key);
+    lock_guard guard(shard.mutex);
+    const auto existing = shard.entries.find(key);
+    if (existing != shard.entries.end()) {
+        // выдачу той же или более новой эпохи уже положил другой поток
+        if (existing->second.epoch >= epoch) {
+            return;
+        }
+        Erase(shard, existing);
+    }
+    const auto [it, inserted] = shard.entries.emplace(move(key), Entry{move(documents), epoch, bytes, {}});
+    shard.lru.push_front(&it->first);
+    it->second.lru_position = shard.lru.begin();
+    shard.bytes += bytes;
+    Evict(shard, budget);
+}
+
+QueryCacheStats QueryCache::GetStats() const {
+    QueryCacheStats stats;
+    stats.hits = hits_.load(memory_order_relaxed);
+    stats.misses = misses_.load(memory_order_relaxed);
+    for (const Shard& shard : shards_) {
+        lock_guard guard(shard.mutex);
+        stats.entries += shard.entries.size();
+        stats.bytes += shard.bytes;
+    }
+    return stats;
+}
+
+QueryCache::Shard& QueryCache::GetShard(const QueryCacheKey& key) {
+    return shards_[QueryCacheKeyHash()(key) % SHARD_COUNT];
+}
+
+void QueryCache::Evict(Shard& shard, size_t budget) {
+    while (shard.bytes > budget) {
+        Erase(shard, shard.entries.find(*shard.lru.back()));
+    }
+}
+
+void QueryCache::Erase(Shard& shard, unordered_map<QueryCacheKey, Entry, QueryCacheKeyHash>::iterator it) {
+    shard.bytes -= it->second.bytes;
+    shard.lru.erase(it->second.lru_position);
+    shard.entries.erase(it);
+}
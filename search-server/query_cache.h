@@ -0,0 +1,82 @@
+#pragma once
+#include "document.h"
+#include "term_dictionary.h"
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Запрос в том виде, в каком его разбирает ParseQuery: слова упорядочены и без повторов,
+// поэтому запросы, отличающиеся порядком или повтором слов, дают один ключ.
+struct QueryCacheKey {
+    std::vector<TermId> plus_words;
+    std::vector<TermId> minus_words;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    size_t top_k = 0;
+    size_t offset = 0;
+
+    bool operator==(const QueryCacheKey& other) const;
+};
+
+struct QueryCacheKeyHash {
+    size_t operator()(const QueryCacheKey& key) const;
+};
+
+struct QueryCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    size_t entries = 0;
+    size_t bytes = 0;
+};
+
+// Кэш выдачи, разбитый на части со своим мьютексом и своим LRU, чтобы потоки запросов
+// не ждали друг друга. Объём считается в байтах и делится между частями поровну.
+// Каждая запись помечена эпохой индекса, при которой она посчитана: запись другой эпохи
+// считается промахом и удаляется, поэтому после изменения индекса старая выдача не вернётся.
+class QueryCache {
+public:
+    QueryCache();
+
+    // 0 выключает кэш и освобождает записи; можно вызывать одновременно с запросами
+    void SetByteBudget(size_t byte_budget);
+
+    bool IsEnabled() const {
+        return byte_budget_.load(std::memory_order_relaxed) > 0;
+    }
+
+    // при попадании выдача копируется в documents, его память переиспользуется
+    bool Find(const QueryCacheKey& key, uint64_t epoch, std::vector<Document>& documents);
+
+    void Insert(QueryCacheKey key, uint64_t epoch, std::vector<Document> documents);
+
+    QueryCacheStats GetStats() const;
+
+private:
+    static const size_t SHARD_COUNT = 16;
+
+    struct Entry {
+        std::vector<Document> documents;
+        uint64_t epoch;
+        size_t bytes;
+        std::list<const QueryCacheKey*>::iterator lru_position;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<QueryCacheKey, Entry, QueryCacheKeyHash> entries;
+        std::list<const QueryCacheKey*> lru;   // ключи записей, в начале недавно использованные
+        size_t bytes = 0;
+    };
+
+    Shard& GetShard(const QueryCacheKey& key);
+    // удаляет давно не использованные записи, пока часть не уложится в budget
+    static void Evict(Shard& shard, size_t budget);
+    static void Erase(Shard& shard, std::unordered_map<QueryCacheKey, Entry, QueryCacheKeyHash>::iterator it);
+
+    std::vector<Shard> shards_;
+    std::atomic<size_t> byte_budget_{0};
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+};
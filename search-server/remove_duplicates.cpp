@@ -1,26 +1,37 @@
 #include "remove_duplicates.h"
+#include <unordered_map>
 #include <vector>
 using namespace std;
 
 void RemoveDuplicates(SearchServer& search_server){
+    // Отпечатки наборов слов считаются параллельно, затем документы проверяются по возрастанию id:
+    // из одинаковых остаётся документ с меньшим id. Совпавшие отпечатки сверяются по прямому индексу.
+    const vector<int> document_ids(search_server.begin(), search_server.end());
+    vector<DocumentTerms> terms(document_ids.size());
+    vector<TermSetFingerprint> fingerprints(document_ids.size());
+    search_server.GetThreadPool()->ParallelFor(document_ids.size(), 0, [&](size_t i) {
+        terms[i] = search_server.GetDocumentTerms(document_ids[i]);
+        fingerprints[i] = ComputeFingerprint(terms[i]);
+    });
+
     vector<int> id_to_remove;
-    vector<string> words;
-    map<vector<string>, int> words_in_doc;
-    for (const int document_id : search_server) {
-        for (auto [word, _] : search_server.GetWordFrequencies(document_id)) {
-            words.push_back(word);
+    unordered_multimap<TermSetFingerprint, size_t, TermSetFingerprintHash> first_documents;
+    first_documents.reserve(document_ids.size());
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        const auto [first, last] = first_documents.equal_range(fingerprints[i]);
+        bool is_duplicate = false;
+        for (auto it = first; it != last && !is_duplicate; ++it) {
+            is_duplicate = HaveSameTerms(terms[it->second], terms[i]);
         }
-        if (words_in_doc.find(words)!=words_in_doc.end()){
-            id_to_remove.push_back(document_id);
-            cout<<"Found duplicate document id "s<<document_id<<"\n"s;
-            words.clear();
+        if (is_duplicate) {
+            id_to_remove.push_back(document_ids[i]);
+            cout<<"Found duplicate document id "s<<document_ids[i]<<"\n"s;
         }
         else {
-            words_in_doc.insert({words,document_id});
-            words.clear();
+            first_documents.emplace(fingerprints[i], i);
         }
     }
     for (const int& id : id_to_remove){
         search_server.RemoveDocument(id);
     }
-}
\ No newline at end of file
+}
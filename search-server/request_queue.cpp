@@ -1,25 +1,149 @@
 #include "request_queue.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <thread>
 using namespace std;
 
-RequestQueue::RequestQueue(const SearchServer& search_server) : inner_server_(search_server) {
+namespace {
+
+size_t GetLatencyBin(chrono::steady_clock::duration latency) {
+    auto microseconds = chrono::duration_cast<chrono::microseconds>(latency).count();
+    size_t bin = 0;
+    while (microseconds > 0 && bin + 1 < LATENCY_BIN_COUNT) {
+        microseconds >>= 1;
+        ++bin;
     }
+    return bin;
+}
+
+} // namespace
+
+chrono::microseconds RequestWindowStats::GetLatencyQuantile(double quantile) const {
+    if (request_count == 0) {
+        return chrono::microseconds(0);
+    }
+    // номер запроса квантиля среди упорядоченных по времени, с единицы
+    const uint64_t rank = max<uint64_t>(1, static_cast<uint64_t>(ceil(quantile * request_count)));
+    uint64_t seen = 0;
+    for (size_t bin = 0; bin < LATENCY_BIN_COUNT; ++bin) {
+        seen += latency_histogram[bin];
+        if (seen >= rank) {
+            return chrono::microseconds(int64_t{1} << bin);
+        }
+    }
+    return chrono::microseconds(int64_t{1} << (LATENCY_BIN_COUNT - 1));
+}
+
+RequestQueue::RequestQueue(const SearchServer& search_server, const RequestQueueOptions& options)
+    : inner_server_(search_server)
+    , step_duration_(options.bucket_count > 0 ? options.window / static_cast<int64_t>(options.bucket_count) : chrono::steady_clock::duration::zero())
+    , bucket_count_(options.bucket_count)
+    , result_bin_count_(options.max_result_count + 2) {
+    if (step_duration_ <= chrono::steady_clock::duration::zero()) {
+        throw invalid_argument("Window must be longer than bucket_count ticks"s);
+    }
+    if (result_bin_count_ < 2) {
+        throw invalid_argument("Result count histogram is too large"s);
+    }
+    buckets_ = make_unique<Bucket[]>(bucket_count_);
+    result_counts_ = make_unique<atomic<uint64_t>[]>(bucket_count_ * result_bin_count_);
+}
 
 vector<Document> RequestQueue::AddFindRequest(const string& raw_query, DocumentStatus status) {
-        return RequestQueue::AddFindRequest(
-            raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-                return document_status == status;
-            });
+        return RequestQueue::AddFindRequest(raw_query, StatusPredicate{status});
     }
 
 vector<Document> RequestQueue::AddFindRequest(const string& raw_query) {
         return RequestQueue::AddFindRequest(raw_query, DocumentStatus::ACTUAL);
     }
 
+void RequestQueue::RecordRequest(size_t result_count, chrono::steady_clock::duration latency) {
+    RequestQueue::RecordRequest(result_count, latency, chrono::steady_clock::now());
+}
+
+void RequestQueue::RecordRequest(size_t result_count, chrono::steady_clock::duration latency, chrono::steady_clock::time_point now) {
+    Bucket* bucket = RequestQueue::AcquireBucket(RequestQueue::GetStep(now));
+    if (bucket == nullptr) {
+        return;
+    }
+    bucket->request_count.fetch_add(1, memory_order_relaxed);
+    if (result_count == 0) {
+        bucket->no_result_count.fetch_add(1, memory_order_relaxed);
+    }
+    bucket->latency_histogram[GetLatencyBin(latency)].fetch_add(1, memory_order_relaxed);
+    RequestQueue::GetResultCounts(*bucket)[min(result_count, result_bin_count_ - 1)].fetch_add(1, memory_order_relaxed);
+}
+
 int RequestQueue::GetNoResultRequests() const {
-        int res=0;
-        for (int i=0;i<requests_.size();++i){
-        if (!requests_[i].not_empty)
-            ++res;
+        return static_cast<int>(RequestQueue::GetStats().no_result_count);
+    }
+
+RequestWindowStats RequestQueue::GetStats() const {
+    return RequestQueue::GetStats(step_duration_ * static_cast<int64_t>(bucket_count_), chrono::steady_clock::now());
+}
+
+RequestWindowStats RequestQueue::GetStats(chrono::steady_clock::duration window) const {
+    return RequestQueue::GetStats(window, chrono::steady_clock::now());
+}
+
+RequestWindowStats RequestQueue::GetStats(chrono::steady_clock::duration window, chrono::steady_clock::time_point now) const {
+    const int64_t step = RequestQueue::GetStep(now);
+    const int64_t step_count = min<int64_t>(bucket_count_, (window + step_duration_ - chrono::steady_clock::duration(1)) / step_duration_);
+    RequestWindowStats result;
+    result.result_counts.assign(result_bin_count_, 0);
+    for (size_t i = 0; i < bucket_count_; ++i) {
+        const Bucket& bucket = buckets_[i];
+        const int64_t bucket_step = bucket.step.load(memory_order_acquire);
+        // корзина копит шаг из последних step_count; остальные устарели или обнуляются
+        if (bucket_step < 0 || bucket_step <= step - step_count || bucket_step > step) {
+            continue;
+        }
+        result.request_count += bucket.request_count.load(memory_order_relaxed);
+        result.no_result_count += bucket.no_result_count.load(memory_order_relaxed);
+        for (size_t bin = 0; bin < LATENCY_BIN_COUNT; ++bin) {
+            result.latency_histogram[bin] += bucket.latency_histogram[bin].load(memory_order_relaxed);
+        }
+        const atomic<uint64_t>* result_counts = RequestQueue::GetResultCounts(bucket);
+        for (size_t bin = 0; bin < result_bin_count_; ++bin) {
+            result.result_counts[bin] += result_counts[bin].load(memory_order_relaxed);
         }
-        return res;
-    }
\ No newline at end of file
+    }
+    return result;
+}
+
+int64_t RequestQueue::GetStep(chrono::steady_clock::time_point time) const {
+    return time.time_since_epoch() / step_duration_;
+}
+
+RequestQueue::Bucket* RequestQueue::AcquireBucket(int64_t step) {
+    Bucket& bucket = buckets_[step % static_cast<int64_t>(bucket_count_)];
+    int64_t bucket_step = bucket.step.load(memory_order_acquire);
+    while (bucket_step != step) {
+        if (bucket_step == RESETTING) {
+            // обнуление - несколько десятков записей, ждать его недолго
+            this_thread::yield();
+            bucket_step = bucket.step.load(memory_order_acquire);
+        } else if (bucket_step > step) {
+            // запись опоздала на целое окно: её шаг уже вытеснен
+            return nullptr;
+        } else if (bucket.step.compare_exchange_weak(bucket_step, RESETTING, memory_order_acquire)) {
+            bucket.request_count.store(0, memory_order_relaxed);
+            bucket.no_result_count.store(0, memory_order_relaxed);
+            for (auto& count : bucket.latency_histogram) {
+                count.store(0, memory_order_relaxed);
+            }
+            atomic<uint64_t>* result_counts = RequestQueue::GetResultCounts(bucket);
+            for (size_t bin = 0; bin < result_bin_count_; ++bin) {
+                result_counts[bin].store(0, memory_order_relaxed);
+            }
+            bucket.step.store(step, memory_order_release);
+            return &bucket;
+        }
+    }
+    return &bucket;
+}
+
+atomic<uint64_t>* RequestQueue::GetResultCounts(const Bucket& bucket) const {
+    return result_counts_.get() + (&bucket - buckets_.get()) * result_bin_count_;
+}
@@ -1,42 +1,102 @@
 #pragma once
 #include "search_server.h"
-#include <deque>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
 
+// Запросы с временем в [2^(i-1), 2^i) мкс попадают в корзину i, быстрее 1 мкс - в корзину 0,
+// последняя корзина - все, что дольше.
+const size_t LATENCY_BIN_COUNT = 32;
+
+struct RequestQueueOptions {
+    // статистика хранится за window, окно сдвигается шагами по window / bucket_count
+    std::chrono::steady_clock::duration window = std::chrono::hours(24);
+    size_t bucket_count = 1440;
+    // Гистограмма числа документов: по корзине на каждое число от 0 до max_result_count и
+    // одна - для большего. Для запросов с SearchOptions::top_k больше MAX_RESULT_DOCUMENT_COUNT
+    // задаётся их top_k; память - bucket_count * (max_result_count + 2) счётчиков.
+    size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT;
+};
+
+struct RequestWindowStats {
+    uint64_t request_count = 0;
+    uint64_t no_result_count = 0;
+    std::array<uint64_t, LATENCY_BIN_COUNT> latency_histogram{};
+    // max_result_count + 2 корзины, см. RequestQueueOptions
+    std::vector<uint64_t> result_counts;
+
+    // верхняя граница корзины, в которую попадает квантиль quantile из [0, 1]; 0 - запросов нет
+    std::chrono::microseconds GetLatencyQuantile(double quantile) const;
+};
+
+// Статистика запросов за скользящее окно времени. Окно - кольцо корзин по времени со
+// счётчиками: запись - несколько атомарных прибавлений к корзине текущего шага без блокировок,
+// корзина, из которой ушло время окна, обнуляется первым записывающим в неё потоком.
+// Записывать и читать статистику можно из любых потоков одновременно; при одновременной
+// записи снимок приблизительный.
 class RequestQueue {
 public:
-    explicit RequestQueue(const SearchServer& search_server);
-   
+    explicit RequestQueue(const SearchServer& search_server, const RequestQueueOptions& options = RequestQueueOptions());
+
     template <typename DocumentPredicate>
     std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate);
-    
+
     std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentStatus status);
-    
+
     std::vector<Document> AddFindRequest(const std::string& raw_query);
-    
+
+    // запрос, выполненный в обход AddFindRequest
+    void RecordRequest(size_t result_count, std::chrono::steady_clock::duration latency);
+    void RecordRequest(size_t result_count, std::chrono::steady_clock::duration latency,
+                       std::chrono::steady_clock::time_point now);
+
+    // запросы без результатов за окно
     int GetNoResultRequests() const;
+
+    // за всё окно или за последние window (округляется вверх до шага, не больше окна)
+    RequestWindowStats GetStats() const;
+    RequestWindowStats GetStats(std::chrono::steady_clock::duration window) const;
+    RequestWindowStats GetStats(std::chrono::steady_clock::duration window, std::chrono::steady_clock::time_point now) const;
+
 private:
-    struct QueryResult {
-        bool not_empty;
+    // свои строки кэша у соседних корзин
+    struct alignas(64) Bucket {
+        // номер шага, который копит корзина; RESETTING - корзина обнуляется
+        std::atomic<int64_t> step{EMPTY};
+        std::atomic<uint64_t> request_count{0};
+        std::atomic<uint64_t> no_result_count{0};
+        std::array<std::atomic<uint64_t>, LATENCY_BIN_COUNT> latency_histogram{};
     };
-    std::deque<QueryResult> requests_;
-    const static int min_in_day_ = 1440;
+
+    static const int64_t EMPTY = -1;
+    static const int64_t RESETTING = -2;
+
+    int64_t GetStep(std::chrono::steady_clock::time_point time) const;
+
+    // корзина шага step, обнулённая при переходе к нему; nullptr, если шаг уже вышел из окна
+    Bucket* AcquireBucket(int64_t step);
+
+    // счётчики гистограммы числа документов корзины
+    std::atomic<uint64_t>* GetResultCounts(const Bucket& bucket) const;
+
     const SearchServer& inner_server_;
-    
-}; 
+    std::chrono::steady_clock::duration step_duration_;
+    size_t bucket_count_;
+    size_t result_bin_count_;
+    std::unique_ptr<Bucket[]> buckets_;
+    // гистограммы числа документов: по result_bin_count_ счётчиков на корзину, подряд
+    std::unique_ptr<std::atomic<uint64_t>[]> result_counts_;
+};
 
 template <typename DocumentPredicate>
     std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate) {
     using namespace std;
+        const auto start = chrono::steady_clock::now();
         vector<Document> docs=inner_server_.FindTopDocuments(raw_query,document_predicate);
-        if (docs.empty()){
-        requests_.push_back({false});
-          if (requests_.size()>min_in_day_)
-            requests_.pop_front();
-        }
-        else {
-        requests_.push_back({true});
-          if (requests_.size()>min_in_day_)
-            requests_.pop_front();
-        }
+        const auto finish = chrono::steady_clock::now();
+        RequestQueue::RecordRequest(docs.size(), finish - start, finish);
         return docs;
-    }
\ No newline at end of file
+    }
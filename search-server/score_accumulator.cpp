@@ -0,0 +1,55 @@
+#include "score_accumulator.h"
+#include <utility>
+using namespace std;
+
+void ScoreAccumulator::Prepare(size_t ordinal_count) {
+    if (scores_.size() < ordinal_count) {
+        scores_.resize(ordinal_count, 0.0);
+        states_.resize(ordinal_count, UNTOUCHED);
+    }
+}
+
+void ScoreAccumulator::Clear() {
+    for (const uint32_t ordinal : touched_) {
+        scores_[ordinal] = 0.0;
+        states_[ordinal] = UNTOUCHED;
+    }
+    touched_.clear();
+}
+
+ScoreAccumulatorPool::Lease::Lease(ScoreAccumulatorPool& pool, unique_ptr<ScoreAccumulator> accumulator)
+    : pool_(&pool)
+    , accumulator_(move(accumulator)) {
+}
+
+ScoreAccumulatorPool::Lease::~Lease() {
+    if (accumulator_) {
+        pool_->Release(move(accumulator_));
+    }
+}
+
+ScoreAccumulatorPool::ScoreAccumulatorPool(ScoreAccumulatorPool&& other)
+    : free_(move(other.free_)) {
+}
+
+ScoreAccumulatorPool::Lease ScoreAccumulatorPool::Acquire(size_t ordinal_count) {
+    unique_ptr<ScoreAccumulator> accumulator;
+    {
+        lock_guard guard(mutex_);
+        if (!free_.empty()) {
+            accumulator = move(free_.back());
+            free_.pop_back();
+        }
+    }
+    if (!accumulator) {
+        accumulator = make_unique<ScoreAccumulator>();
+    }
+    accumulator->Prepare(ordinal_count);
+    return Lease(*this, move(accumulator));
+}
+
+void ScoreAccumulatorPool::Release(unique_ptr<ScoreAccumulator> accumulator) {
+    accumulator->Clear();
+    lock_guard guard(mutex_);
+    free_.push_back(move(accumulator));
+}
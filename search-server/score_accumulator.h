@@ -0,0 +1,94 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Релевантности документов в плотном массиве, индекс - ordinal.
+// Номера затронутых документов запоминаются, поэтому Clear обнуляет только их,
+// а не весь массив.
+class ScoreAccumulator {
+public:
+    void Prepare(size_t ordinal_count);
+
+    // исключённый документ не оценивается
+    void Add(uint32_t ordinal, double score) {
+        State& state = states_[ordinal];
+        if (state != SCORED) {
+            if (state == EXCLUDED) {
+                return;
+            }
+            state = SCORED;
+            touched_.push_back(ordinal);
+        }
+        scores_[ordinal] += score;
+    }
+
+    // Документ с минус-словом исключается из выдачи. Исключения ставятся до подсчёта
+    // релевантности, чтобы такие документы не оценивались вовсе.
+    void Exclude(uint32_t ordinal) {
+        State& state = states_[ordinal];
+        if (state == UNTOUCHED) {
+            touched_.push_back(ordinal);
+        }
+        state = EXCLUDED;
+    }
+
+    template <typename Callback>
+    void ForEachScored(Callback callback) const {
+        for (const uint32_t ordinal : touched_) {
+            if (states_[ordinal] == SCORED) {
+                callback(ordinal, scores_[ordinal]);
+            }
+        }
+    }
+
+    void Clear();
+
+private:
+    enum State : uint8_t {
+        UNTOUCHED,
+        SCORED,
+        EXCLUDED,
+    };
+
+    std::vector<double> scores_;
+    std::vector<State> states_;
+    std::vector<uint32_t> touched_;
+};
+
+// Переиспользуемые аккумуляторы: каждый поток запроса берёт свой, поэтому
+// подсчёт релевантности идёт без блокировок. Мьютекс нужен только при выдаче и возврате.
+class ScoreAccumulatorPool {
+public:
+    class Lease {
+    public:
+        Lease(ScoreAccumulatorPool& pool, std::unique_ptr<ScoreAccumulator> accumulator);
+        Lease(Lease&& other) = default;
+        Lease& operator=(Lease&& other) = delete;
+        ~Lease();
+
+        ScoreAccumulator& operator*() const {
+            return *accumulator_;
+        }
+
+        ScoreAccumulator* operator->() const {
+            return accumulator_.get();
+        }
+
+    private:
+        ScoreAccumulatorPool* pool_;
+        std::unique_ptr<ScoreAccumulator> accumulator_;
+    };
+
+    ScoreAccumulatorPool() = default;
+    ScoreAccumulatorPool(ScoreAccumulatorPool&& other);
+
+    Lease Acquire(size_t ordinal_count);
+
+private:
+    void Release(std::unique_ptr<ScoreAccumulator> accumulator);
+
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<ScoreAccumulator>> free_;
+};
@@ -1,7 +1,61 @@
 #include "search_server.h"
 #include <numeric>
+#include <stdexcept>
+#include <unordered_map>
 using namespace std;
 
+namespace {
+
+// столько соседних сегментов одного уровня сливаются в один
+const size_t MERGE_FACTOR = 8;
+// Сегменты меньше этого размера в конце набора образуют изменяемую часть индекса:
+// их сливает сама запись, в фоне они не сливаются.
+const size_t MUTABLE_SEGMENT_SIZE = MERGE_FACTOR * MERGE_FACTOR;
+// если слияния не успевают за записью, запись ждёт (запросы не ждут никогда)
+const size_t MAX_SEGMENT_COUNT = 64;
+// сегмент перестраивается в фоне, когда удалена 1/COMPACTION_RATIO его документов
+const size_t COMPACTION_RATIO = 4;
+
+// уровень сегмента - порядок его размера по основанию MERGE_FACTOR
+int GetMergeLevel(size_t size) {
+    int level = 0;
+    for (; size >= MERGE_FACTOR; size /= MERGE_FACTOR) {
+        ++level;
+    }
+    return level;
+}
+
+template <typename Segments>
+bool IsMergeRun(const Segments& segments, size_t first) {
+    const int level = GetMergeLevel(segments[first]->size());
+    return all_of(segments.begin() + first, segments.begin() + first + MERGE_FACTOR, [level](const auto& segment) {
+        return GetMergeLevel(segment->size()) == level;
+    });
+}
+
+// частичный индекс, который строит один поток пакетного добавления
+struct BatchChunk {
+    size_t first_document = 0;
+    size_t last_document = 0;
+    unordered_map<string_view, uint32_t> term_ids;   // слова ссылаются на тексты пакета
+    vector<string_view> terms;
+    vector<vector<pair<uint32_t, uint32_t>>> postings;          // локальный id слова -> (номер в пакете, число вхождений)
+    vector<vector<pair<uint32_t, uint32_t>>> document_terms;    // документ части -> (локальный id слова, число вхождений)
+};
+
+} // namespace
+
+template <typename Function>
+void SearchServer::ForEachIndex(size_t count, bool parallel, Function function) const {
+    if (parallel) {
+        SearchServer::GetThreadPool()->ParallelFor(count, 1, function);
+    } else {
+        for (size_t i = 0; i < count; ++i) {
+            function(i);
+        }
+    }
+}
+
 SearchServer::SearchServer(const string& stop_words_text)
         : SearchServer(
             SplitIntoWords(stop_words_text)) 
@@ -12,109 +66,860 @@ SearchServer::SearchServer(const string_view stop_words_text) : SearchServer(Spl
 {
 }
 
+SearchServer::SearchServer(shared_ptr<const MappedFile> snapshot_file, SnapshotReader reader)
+    : stop_words_(MakeUniqueNonEmptyStrings(SplitIntoWords(reader.ReadString())))
+    , dictionary_(TermDictionary::ReadFrom(reader))
+    , snapshot_file_(move(snapshot_file))
+{
+    auto segments = make_shared<SegmentList>();
+    const auto segment_count = reader.ReadValue<uint64_t>();
+    for (uint64_t i = 0; i < segment_count; ++i) {
+        segments->segments.push_back(IndexSegment::ReadFrom(reader));
+    }
+    forward_index_ = ForwardIndex::ReadFrom(reader);
+    if (forward_index_.size() != SearchServer::CountDocuments(*segments)) {
+        throw runtime_error("Snapshot is corrupted"s);
+    }
+    forward_index_.ForEachDocument([this](int document_id, DocumentTerms) {
+        document_ids_.insert(document_id);
+    });
+    segments_ = move(segments);
+}
+
+SearchServer::~SearchServer() {
+    {
+        lock_guard guard(write_mutex_);
+        stop_merges_ = true;
+    }
+    merge_condition_.notify_all();
+    if (merge_thread_.joinable()) {
+        merge_thread_.join();
+    }
+}
+
+void SearchServer::SaveSnapshot(const string& path) const {
+    // запись и слияния ждут, пока снимок не будет сохранён
+    lock_guard write_guard(write_mutex_);
+    SnapshotWriter writer(path);
+    string stop_words_text;
+    for (const string& word : stop_words_) {
+        stop_words_text += word + " "s;
+    }
+    writer.WriteString(stop_words_text);
+    dictionary_.WriteTo(writer);
+    // удалённые документы в снимок не попадают
+    vector<shared_ptr<const IndexSegment>> segments;
+    const auto current = SearchServer::AcquireSegments();
+    for (const auto& segment : current->segments) {
+        if (segment->removed_count() == 0) {
+            segments.push_back(segment);
+        } else if (segment->live_size() > 0) {
+            segments.push_back(IndexSegment::Merge({segment.get()}));
+        }
+    }
+    writer.WriteValue<uint64_t>(segments.size());
+    for (const auto& segment : segments) {
+        segment->WriteTo(writer);
+    }
+    forward_index_.WriteTo(writer);
+    writer.Finish();
+}
+
+SearchServer SearchServer::OpenSnapshot(const string& path) {
+    auto snapshot_file = make_shared<const MappedFile>(path);
+    SnapshotReader reader(*snapshot_file);
+    return SearchServer(move(snapshot_file), reader);
+}
+
 
 void SearchServer::AddDocument(int document_id,string_view document, DocumentStatus status, const vector<int>& ratings) {
-        if ((document_id < 0) || (documents_.count(document_id) > 0)) {
+        unique_lock write_lock(write_mutex_);
+        if ((document_id < 0) || (document_ids_.count(document_id) > 0)) {
             throw invalid_argument("Invalid document_id"s);
         }
+        if (static_cast<size_t>(status) >= DOCUMENT_STATUS_COUNT) {
+            throw invalid_argument("Invalid document status"s);
+        }
         const auto words = SearchServer::SplitIntoWordsNoStop(document);
 
-        const double inv_word_count = 1.0 / words.size();
-        for (const string& word : words) {
-            words_.push_back(word);
-            word_to_document_freqs_[*find(words_.begin(),words_.end(),word)][document_id]+=inv_word_count;
-            id_to_word_freqs_[document_id][*find(words_.begin(),words_.end(),word)]+=inv_word_count;
+        map<TermId, uint32_t> term_counts;
+        for (const string_view word : words) {
+            ++term_counts[dictionary_.Intern(word)];
         }
-   
-        documents_.emplace(document_id, SearchServer::DocumentData{SearchServer::ComputeAverageRating(ratings), status});
-        document_ids_.insert(document_id);
+        CowArray<TermId> terms;
+        PostingArena postings;
+        PostingList term_postings;
+        vector<TermFrequency> word_freqs;
+        for (const auto [term_id, count] : term_counts) {
+            terms.push_back(term_id);
+            term_postings.Clear();
+            term_postings.Add(0, count, count * 1.0 / words.size());
+            postings.Append(term_postings);
+            word_freqs.push_back({term_id, 0, count * 1.0 / words.size()});
+        }
+        TermSetFingerprint fingerprint;
+        int original_id = -1;
+        if (duplicate_policy_ != DuplicatePolicy::ALLOW) {
+            const DocumentTerms document_terms(word_freqs.data(), word_freqs.size());
+            fingerprint = ComputeFingerprint(document_terms);
+            original_id = SearchServer::FindDuplicate(fingerprint, document_terms);
+            if (original_id >= 0 && duplicate_policy_ == DuplicatePolicy::REJECT) {
+                throw invalid_argument("Duplicate document"s);
+            }
+        }
+        IndexSegment::DocumentColumns documents;
+        documents.push_back({document_id, SearchServer::ComputeAverageRating(ratings), status, static_cast<uint32_t>(words.size())});
+        {
+            unique_lock guard(documents_mutex_);
+            forward_index_.Add(document_id, word_freqs);
+            document_ids_.insert(document_id);
+            if (original_id >= 0) {
+                flagged_duplicates_.emplace(document_id, original_id);
+            }
+        }
+        if (duplicate_policy_ != DuplicatePolicy::ALLOW) {
+            fingerprints_.emplace(fingerprint, document_id);
+        }
+        if (near_duplicate_index_) {
+            unique_lock guard(near_duplicates_mutex_);
+            near_duplicate_index_->AddDocuments({document_id});
+        }
+        SearchServer::AppendSegment(write_lock, make_shared<const IndexSegment>(move(documents), move(terms), move(postings)));
     }
 
+void SearchServer::PublishSegments(shared_ptr<const SegmentList> segments) {
+    atomic_store(&segments_, move(segments));
+}
 
-vector<Document> SearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status) const {
-        return SearchServer::FindTopDocuments(
-            raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-                return document_status == status;
+void SearchServer::AppendSegment(unique_lock<mutex>& write_lock, shared_ptr<const IndexSegment> segment) {
+    auto segments = make_shared<SegmentList>(*SearchServer::AcquireSegments());
+    auto& list = segments->segments;
+    list.push_back(move(segment));
+    // изменяемая часть сливается сразу, по MERGE_FACTOR сегментов одного уровня; если уровни
+    // перемешаны и сегментов накопилось больше, чем бывает при таком слиянии, - вся целиком
+    while (true) {
+        size_t mutable_first = list.size();
+        while (mutable_first > 0 && list[mutable_first - 1]->size() < MUTABLE_SEGMENT_SIZE) {
+            --mutable_first;
+        }
+        size_t first = list.size();
+        if (list.size() - mutable_first >= MERGE_FACTOR && IsMergeRun(list, list.size() - MERGE_FACTOR)) {
+            first = list.size() - MERGE_FACTOR;
+        } else if (list.size() - mutable_first > 2 * (MERGE_FACTOR - 1)) {
+            first = mutable_first;
+        }
+        if (first == list.size()) {
+            break;
+        }
+        vector<const IndexSegment*> inputs;
+        for (size_t i = first; i < list.size(); ++i) {
+            inputs.push_back(list[i].get());
+        }
+        auto merged = IndexSegment::Merge(inputs);
+        list.resize(first);
+        if (merged->size() > 0) {
+            list.push_back(move(merged));
+        }
+    }
+    const bool needs_merge = SearchServer::FindMergeCandidate(*segments).count > 0;
+    SearchServer::PublishSegments(move(segments));
+    index_epoch_.fetch_add(1, memory_order_release);
+    if (!needs_merge) {
+        return;
+    }
+    SearchServer::WakeMerges();
+    merge_condition_.wait(write_lock, [this] {
+        return SearchServer::AcquireSegments()->segments.size() <= MAX_SEGMENT_COUNT;
+    });
+}
+
+void SearchServer::WakeMerges() {
+    if (!merge_thread_.joinable()) {
+        merge_thread_ = thread([this] {
+            SearchServer::RunMerges();
+        });
+    }
+    merge_condition_.notify_all();
+}
+
+SearchServer::MergeRange SearchServer::FindMergeCandidate(const SegmentList& list) {
+    const auto& segments = list.segments;
+    // изменяемую часть запись может заменить в любой момент
+    size_t sealed_count = segments.size();
+    while (sealed_count > 0 && segments[sealed_count - 1]->size() < MUTABLE_SEGMENT_SIZE) {
+        --sealed_count;
+    }
+    if (sealed_count >= MERGE_FACTOR) {
+        for (size_t first = sealed_count - MERGE_FACTOR + 1; first-- > 0;) {
+            if (IsMergeRun(segments, first)) {
+                return {first, MERGE_FACTOR};
+            }
+        }
+    }
+    // уровни перемешаны, а сегментов уже много: сливаются соседние с наименьшим общим размером
+    if (sealed_count < max(MERGE_FACTOR, MAX_SEGMENT_COUNT / 2)) {
+        // сегмент, в котором много удалённых документов, перестраивается отдельно;
+        // изменяемую часть тоже можно: если запись её заменит, перестройка просто не применится
+        for (size_t i = 0; i < segments.size(); ++i) {
+            if (segments[i]->removed_count() * COMPACTION_RATIO >= segments[i]->size()) {
+                return {i, 1};
+            }
+        }
+        return {};
+    }
+    size_t best_first = 0;
+    size_t best_size = numeric_limits<size_t>::max();
+    for (size_t first = 0; first + MERGE_FACTOR <= sealed_count; ++first) {
+        size_t size = 0;
+        for (size_t i = first; i < first + MERGE_FACTOR; ++i) {
+            size += segments[i]->size();
+        }
+        if (size < best_size) {
+            best_first = first;
+            best_size = size;
+        }
+    }
+    return {best_first, MERGE_FACTOR};
+}
+
+void SearchServer::RunMerges() {
+    unique_lock lock(write_mutex_);
+    while (true) {
+        merge_condition_.wait(lock, [this] {
+            return stop_merges_ || SearchServer::FindMergeCandidate(*SearchServer::AcquireSegments()).count > 0;
+        });
+        if (stop_merges_) {
+            return;
+        }
+        const auto segments = SearchServer::AcquireSegments();
+        const auto [first, count] = SearchServer::FindMergeCandidate(*segments);
+        vector<const IndexSegment*> inputs;
+        for (size_t i = first; i < first + count; ++i) {
+            inputs.push_back(segments->segments[i].get());
+        }
+        // сегменты неизменяемы, поэтому сливаются без блокировки; segments держит их живыми
+        merging_ = true;
+        lock.unlock();
+        shared_ptr<const IndexSegment> merged = IndexSegment::Merge(inputs);
+        lock.lock();
+        merging_ = false;
+        auto removals = move(merge_removals_);
+        merge_removals_.clear();
+
+        // пока шло слияние, запись могла заменить один из сегментов - тогда слияние начнётся заново
+        const auto current = SearchServer::AcquireSegments();
+        const auto it = find(current->segments.begin(), current->segments.end(), segments->segments[first]);
+        if (current->segments.end() - it < static_cast<ptrdiff_t>(count)
+            || !equal(it, it + count, segments->segments.begin() + first)) {
+            continue;
+        }
+        // удаления, сделанные во время слияния, переносятся в новый сегмент
+        for (const auto& [document_id, terms] : removals) {
+            const uint32_t ordinal = merged->FindDocument(document_id);
+            if (ordinal != NO_ORDINAL) {
+                merged->MarkRemoved(ordinal, terms);
+            }
+        }
+        auto next = make_shared<SegmentList>(*current);
+        const auto position = next->segments.begin() + (it - current->segments.begin());
+        if (merged->size() > 0) {
+            *position = move(merged);
+            next->segments.erase(position + 1, position + count);
+        } else {
+            next->segments.erase(position, position + count);
+        }
+        SearchServer::PublishSegments(move(next));
+        merge_condition_.notify_all();
+    }
+}
+
+pair<const IndexSegment*, uint32_t> SearchServer::LocateDocument(const SegmentList& segments, int document_id) {
+    for (const auto& segment : segments.segments) {
+        const uint32_t ordinal = segment->FindDocument(document_id);
+        if (ordinal != NO_ORDINAL) {
+            return {segment.get(), ordinal};
+        }
+    }
+    return {nullptr, NO_ORDINAL};
+}
+
+size_t SearchServer::CountDocuments(const SegmentList& segments) {
+    size_t document_count = 0;
+    for (const auto& segment : segments.segments) {
+        document_count += segment->live_size();
+    }
+    return document_count;
+}
+
+
+void SearchServer::AddDocuments(const vector<DocumentInput>& documents) {
+    SearchServer::AddDocumentsBatch(documents, 1);
+}
+
+void SearchServer::AddDocumentsBatch(const vector<DocumentInput>& documents, size_t chunk_count) {
+    if (documents.empty()) {
+        return;
+    }
+    chunk_count = max<size_t>(1, min(chunk_count, documents.size()));
+    const bool parallel = chunk_count > 1;
+    vector<uint32_t> lengths(documents.size());
+    vector<string> word_errors(documents.size());
+
+    // 1. каждый поток разбирает свою часть пакета в частичный индекс с локальными id слов
+    vector<BatchChunk> chunks(chunk_count);
+    ForEachIndex(chunk_count, parallel, [&](size_t chunk_index) {
+        BatchChunk& chunk = chunks[chunk_index];
+        chunk.first_document = documents.size() * chunk_index / chunk_count;
+        chunk.last_document = documents.size() * (chunk_index + 1) / chunk_count;
+        vector<uint32_t> local_ids;
+        for (size_t i = chunk.first_document; i < chunk.last_document; ++i) {
+            auto& document_terms = chunk.document_terms.emplace_back();
+            vector<string_view> words;
+            try {
+                words = SearchServer::SplitIntoWordsNoStop(documents[i].text);
+            } catch (const invalid_argument& error) {
+                word_errors[i] = error.what();
+                continue;
+            }
+            lengths[i] = static_cast<uint32_t>(words.size());
+            local_ids.clear();
+            for (const string_view word : words) {
+                const auto [it, inserted] = chunk.term_ids.emplace(word, static_cast<uint32_t>(chunk.terms.size()));
+                if (inserted) {
+                    chunk.terms.push_back(it->first);
+                    chunk.postings.emplace_back();
+                }
+                local_ids.push_back(it->second);
+            }
+            sort(local_ids.begin(), local_ids.end());
+            for (size_t begin = 0; begin < local_ids.size();) {
+                size_t end = begin;
+                while (end < local_ids.size() && local_ids[end] == local_ids[begin]) {
+                    ++end;
+                }
+                const uint32_t count = static_cast<uint32_t>(end - begin);
+                document_terms.emplace_back(local_ids[begin], count);
+                chunk.postings[local_ids[begin]].emplace_back(static_cast<uint32_t>(i), count);
+                begin = end;
+            }
+        }
+    });
+
+    // 2. ошибки проверяются в порядке документов, как при последовательных вызовах AddDocument
+    unique_lock write_lock(write_mutex_);
+    set<int> batch_ids;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const int document_id = documents[i].id;
+        if ((document_id < 0) || (document_ids_.count(document_id) > 0) || !batch_ids.insert(document_id).second) {
+            throw invalid_argument("Invalid document_id"s);
+        }
+        if (static_cast<size_t>(documents[i].status) >= DOCUMENT_STATUS_COUNT) {
+            throw invalid_argument("Invalid document status"s);
+        }
+        if (!word_errors[i].empty()) {
+            throw invalid_argument(word_errors[i]);
+        }
+    }
+
+    // 3. локальные id переводятся в общий словарь, затем списки каждого слова нового
+    // сегмента собираются параллельно: части идут по порядку, поэтому номера возрастают
+    vector<vector<TermId>> to_global(chunk_count);
+    for (size_t chunk_index = 0; chunk_index < chunk_count; ++chunk_index) {
+        for (const string_view term : chunks[chunk_index].terms) {
+            to_global[chunk_index].push_back(dictionary_.Intern(term));
+        }
+    }
+    const uint32_t NONE = numeric_limits<uint32_t>::max();
+    vector<uint32_t> merge_slot(dictionary_.size(), NONE);
+    vector<vector<pair<size_t, uint32_t>>> merge_sources;   // слово -> (часть, локальный id)
+    vector<TermId> merge_terms;
+    for (size_t chunk_index = 0; chunk_index < chunk_count; ++chunk_index) {
+        for (uint32_t local_id = 0; local_id < to_global[chunk_index].size(); ++local_id) {
+            const TermId term_id = to_global[chunk_index][local_id];
+            if (merge_slot[term_id] == NONE) {
+                merge_slot[term_id] = static_cast<uint32_t>(merge_terms.size());
+                merge_terms.push_back(term_id);
+                merge_sources.emplace_back();
+            }
+            merge_sources[merge_slot[term_id]].emplace_back(chunk_index, local_id);
+        }
+    }
+    vector<uint32_t> slots(merge_terms.size());
+    iota(slots.begin(), slots.end(), 0);
+    sort(slots.begin(), slots.end(), [&merge_terms](uint32_t lhs, uint32_t rhs) {
+        return merge_terms[lhs] < merge_terms[rhs];
+    });
+    CowArray<TermId> terms;
+    for (const uint32_t slot : slots) {
+        terms.push_back(merge_terms[slot]);
+    }
+    vector<PostingList> term_postings(slots.size());
+    ForEachIndex(slots.size(), parallel, [&](size_t index) {
+        for (const auto& [chunk_index, local_id] : merge_sources[slots[index]]) {
+            for (const auto& [document_index, count] : chunks[chunk_index].postings[local_id]) {
+                term_postings[index].Add(document_index, count, count * 1.0 / lengths[document_index]);
+            }
+        }
+    });
+    PostingArena postings;
+    for (const PostingList& list : term_postings) {
+        postings.Append(list);
+    }
+
+    // 4. слова документов в общих id, отпечатки для проверки дубликатов
+    const bool check_duplicates = duplicate_policy_ != DuplicatePolicy::ALLOW;
+    vector<vector<TermFrequency>> word_freqs(documents.size());
+    vector<TermSetFingerprint> fingerprints(check_duplicates ? documents.size() : 0);
+    ForEachIndex(chunk_count, parallel, [&](size_t chunk_index) {
+        const BatchChunk& chunk = chunks[chunk_index];
+        for (size_t i = chunk.first_document; i < chunk.last_document; ++i) {
+            for (const auto& [local_id, count] : chunk.document_terms[i - chunk.first_document]) {
+                word_freqs[i].push_back({to_global[chunk_index][local_id], 0, count * 1.0 / lengths[i]});
+            }
+            sort(word_freqs[i].begin(), word_freqs[i].end(), [](const TermFrequency& lhs, const TermFrequency& rhs) {
+                return lhs.term_id < rhs.term_id;
             });
+            if (check_duplicates) {
+                fingerprints[i] = ComputeFingerprint(DocumentTerms(word_freqs[i].data(), word_freqs[i].size()));
+            }
+        }
+    });
+
+    // 5. дубликаты ищутся по порядку документов: в индексе, затем среди предыдущих документов пакета
+    vector<int> original_ids(documents.size(), -1);
+    if (check_duplicates) {
+        unordered_multimap<TermSetFingerprint, size_t, TermSetFingerprintHash> batch_fingerprints;
+        for (size_t i = 0; i < documents.size(); ++i) {
+            const DocumentTerms document_terms(word_freqs[i].data(), word_freqs[i].size());
+            original_ids[i] = SearchServer::FindDuplicate(fingerprints[i], document_terms);
+            if (original_ids[i] < 0) {
+                const auto [first, last] = batch_fingerprints.equal_range(fingerprints[i]);
+                for (auto it = first; it != last; ++it) {
+                    if (HaveSameTerms(DocumentTerms(word_freqs[it->second].data(), word_freqs[it->second].size()), document_terms)) {
+                        original_ids[i] = documents[it->second].id;
+                        break;
+                    }
+                }
+            }
+            if (original_ids[i] >= 0 && duplicate_policy_ == DuplicatePolicy::REJECT) {
+                throw invalid_argument("Duplicate document"s);
+            }
+            batch_fingerprints.emplace(fingerprints[i], i);
+        }
+    }
+
+    // 6. прямой индекс и данные документов
+    IndexSegment::DocumentColumns segment_documents;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const DocumentInput& document = documents[i];
+        segment_documents.push_back({document.id, SearchServer::ComputeAverageRating(document.ratings), document.status, lengths[i]});
+    }
+    {
+        unique_lock guard(documents_mutex_);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            forward_index_.Add(documents[i].id, word_freqs[i]);
+            document_ids_.insert(documents[i].id);
+            if (original_ids[i] >= 0) {
+                flagged_duplicates_.emplace(documents[i].id, original_ids[i]);
+            }
+        }
+    }
+    for (size_t i = 0; i < fingerprints.size(); ++i) {
+        fingerprints_.emplace(fingerprints[i], documents[i].id);
+    }
+    if (near_duplicate_index_) {
+        vector<int> document_ids(documents.size());
+        transform(documents.begin(), documents.end(), document_ids.begin(), [](const DocumentInput& document) {
+            return document.id;
+        });
+        unique_lock guard(near_duplicates_mutex_);
+        near_duplicate_index_->AddDocuments(document_ids);
+    }
+    SearchServer::AppendSegment(write_lock, make_shared<const IndexSegment>(move(segment_documents), move(terms), move(postings)));
+}
+
+vector<Document> SearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status) const {
+        return SearchServer::FindTopDocuments(execution::seq, raw_query, status, SearchOptions());
+    }
+
+vector<Document> SearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status, const SearchOptions& options) const {
+        return SearchServer::FindTopDocuments(execution::seq, raw_query, status, options);
     }
 
  vector<Document> SearchServer::FindTopDocuments(string_view raw_query) const {
         return SearchServer::FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
     }
 
+ vector<Document> SearchServer::FindTopDocuments(string_view raw_query, const SearchOptions& options) const {
+        return SearchServer::FindTopDocuments(raw_query, DocumentStatus::ACTUAL, options);
+    }
+
+void SearchServer::FindTopDocuments(string_view raw_query, const SearchOptions& options, vector<Document>& result) const {
+    // эпоха читается раньше набора сегментов, как в перегрузке, возвращающей выдачу
+    const uint64_t epoch = index_epoch_.load(memory_order_acquire);
+    const auto segments = SearchServer::AcquireSegments();
+    PreparedQuery query;
+    query.query_ = SearchServer::ParseQuery(raw_query);
+    const bool use_cache = query_cache_.IsEnabled() && options.corpus_statistics == nullptr && corpus_statistics_ == nullptr;
+    QueryCacheKey key;
+    if (use_cache) {
+        key = {query.query_.plus_words, query.query_.minus_words, DocumentStatus::ACTUAL, options.top_k, options.offset};
+        if (query_cache_.Find(key, epoch, result)) {
+            return;
+        }
+    }
+    query.words_ = SearchServer::ComputeTermWeights(*segments, query.query_, options.corpus_statistics);
+    query.epoch_ = epoch;
+    StatusPredicate document_predicate{DocumentStatus::ACTUAL};
+    SearchServer::FindPreparedDocuments(*segments, query, document_predicate, options, result);
+    if (use_cache) {
+        query_cache_.Insert(move(key), epoch, result);
+    }
+}
+
+
+SearchServer::PreparedQuery SearchServer::PrepareQuery(string_view raw_query) const {
+    const uint64_t epoch = index_epoch_.load(memory_order_acquire);
+    return SearchServer::PrepareQuery(*SearchServer::AcquireSegments(), raw_query, epoch);
+}
+
+SearchServer::PreparedQuery SearchServer::PrepareQuery(const SegmentList& segments, string_view raw_query, uint64_t epoch) const {
+    PreparedQuery result;
+    result.raw_query_ = string(raw_query);
+    result.query_ = SearchServer::ParseQuery(raw_query);
+    result.words_ = SearchServer::ComputeTermWeights(segments, result.query_);
+    result.epoch_ = epoch;
+    return result;
+}
+
+vector<Document> SearchServer::FindTopDocuments(const PreparedQuery& query) const {
+    return SearchServer::FindTopDocuments(query, DocumentStatus::ACTUAL, SearchOptions());
+}
+
+vector<Document> SearchServer::FindTopDocuments(const PreparedQuery& query, DocumentStatus status) const {
+    return SearchServer::FindTopDocuments(query, status, SearchOptions());
+}
+
+vector<Document> SearchServer::FindTopDocuments(const PreparedQuery& query, DocumentStatus status, const SearchOptions& options) const {
+    vector<Document> result;
+    SearchServer::FindTopDocuments(query, StatusPredicate{status}, options, result);
+    return result;
+}
 
 int SearchServer::GetDocumentCount() const {
-        return documents_.size();
+        return static_cast<int>(SearchServer::CountDocuments(*SearchServer::AcquireSegments()));
+    }
+
+size_t SearchServer::GetDocumentFrequency(string_view word) const {
+    const TermId term_id = dictionary_.Find(word);
+    if (term_id == INVALID_TERM_ID) {
+        return 0;
+    }
+    size_t document_freq = 0;
+    // набор держится локальной переменной: временный shared_ptr умер бы до конца цикла
+    const auto segments = SearchServer::AcquireSegments();
+    for (const auto& segment : segments->segments) {
+        document_freq += segment->CountDocuments(term_id);
+    }
+    return document_freq;
+}
+
+void SearchServer::SetCorpusStatistics(shared_ptr<const CorpusStatistics> statistics) {
+    corpus_statistics_ = move(statistics);
+}
+
+void SearchServer::SetDuplicatePolicy(DuplicatePolicy policy) {
+    lock_guard write_guard(write_mutex_);
+    if (policy == DuplicatePolicy::ALLOW) {
+        fingerprints_.clear();
+    } else if (duplicate_policy_ == DuplicatePolicy::ALLOW) {
+        vector<pair<int, DocumentTerms>> documents;
+        documents.reserve(forward_index_.size());
+        forward_index_.ForEachDocument([&documents](int document_id, DocumentTerms terms) {
+            documents.emplace_back(document_id, terms);
+        });
+        vector<TermSetFingerprint> fingerprints(documents.size());
+        SearchServer::GetThreadPool()->ParallelFor(documents.size(), 0, [&documents, &fingerprints](size_t i) {
+            fingerprints[i] = ComputeFingerprint(documents[i].second);
+        });
+        fingerprints_.reserve(documents.size());
+        for (size_t i = 0; i < documents.size(); ++i) {
+            fingerprints_.emplace(fingerprints[i], documents[i].first);
+        }
+    }
+    duplicate_policy_ = policy;
+}
+
+map<int, int> SearchServer::GetFlaggedDuplicates() const {
+    shared_lock guard(documents_mutex_);
+    return flagged_duplicates_;
+}
+
+void SearchServer::EnableNearDuplicateIndex(const NearDuplicateOptions& options) {
+    lock_guard write_guard(write_mutex_);
+    auto index = make_unique<NearDuplicateIndex>(*this, options);
+    vector<int> document_ids;
+    {
+        shared_lock guard(documents_mutex_);
+        document_ids.assign(document_ids_.begin(), document_ids_.end());
+    }
+    // подписи считаются без блокировки поиска похожих: под write_mutex_ прямой индекс не перепаковывается
+    index->AddDocuments(document_ids);
+    unique_lock guard(near_duplicates_mutex_);
+    near_duplicate_index_ = move(index);
+}
+
+void SearchServer::DisableNearDuplicateIndex() {
+    lock_guard write_guard(write_mutex_);
+    unique_lock guard(near_duplicates_mutex_);
+    near_duplicate_index_.reset();
+}
+
+vector<int> SearchServer::FindSimilarDocuments(int document_id) const {
+    shared_lock guard(near_duplicates_mutex_);
+    if (!near_duplicate_index_ || !near_duplicate_index_->Contains(document_id)) {
+        return {};
     }
+    return near_duplicate_index_->FindSimilar(document_id);
+}
+
+int SearchServer::FindDuplicate(const TermSetFingerprint& fingerprint, DocumentTerms terms) const {
+    const auto [first, last] = fingerprints_.equal_range(fingerprint);
+    for (auto it = first; it != last; ++it) {
+        if (HaveSameTerms(forward_index_.Find(it->second), terms)) {
+            return it->second;
+        }
+    }
+    return -1;
+}
+
+void SearchServer::SetThreadCount(size_t thread_count) {
+    lock_guard guard(thread_pool_mutex_);
+    if (thread_count != thread_count_) {
+        thread_count_ = thread_count;
+        thread_pool_.reset();
+    }
+}
+
+shared_ptr<ThreadPool> SearchServer::GetThreadPool() const {
+    lock_guard guard(thread_pool_mutex_);
+    if (!thread_pool_) {
+        thread_pool_ = make_shared<ThreadPool>(thread_count_);
+    }
+    return thread_pool_;
+}
+
+void SearchServer::SetQueryCacheBudget(size_t byte_budget) {
+    query_cache_.SetByteBudget(byte_budget);
+}
+
+QueryCacheStats SearchServer::GetQueryCacheStats() const {
+    return query_cache_.GetStats();
+}
 
     
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(string_view raw_query, int document_id) const {
-if (document_ids_.find(document_id)==document_ids_.end()) throw out_of_range("Out of range"s);
+    const auto segments = SearchServer::AcquireSegments();
+    const auto [segment, ordinal] = SearchServer::LocateDocument(*segments, document_id);
+if (segment == nullptr) throw out_of_range("Out of range"s);
     
-        const static auto query = SearchServer::ParseQuery(raw_query);
+        const auto query = SearchServer::ParseQuery(raw_query);
    
         vector<string_view> matched_words;
-        for (const string& word : query.plus_words) {
-            if (word_to_document_freqs_.count(word) == 0) {
-                continue;
-            }
-            if (word_to_document_freqs_.at(word).count(document_id)) {
-                matched_words.push_back(word);
+        for (const TermId word : query.plus_words) {
+            if (segment->Contains(word, ordinal)) {
+                matched_words.push_back(dictionary_.GetTerm(word));
             }
         }
-        for (const string& word : query.minus_words) {
-            if (word_to_document_freqs_.count(word) == 0) {
-                continue;
-            }
-            if (word_to_document_freqs_.at(word).count(document_id)) {
+        for (const TermId word : query.minus_words) {
+            if (segment->Contains(word, ordinal)) {
                 matched_words.clear();
                 break;
             }
         }
-        return {matched_words, documents_.at(document_id).status};
+        sort(matched_words.begin(), matched_words.end());
+        return {matched_words, segment->GetStatus(ordinal)};
     }
 
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const PreparedQuery& prepared, int document_id) const {
+    const uint64_t epoch = index_epoch_.load(memory_order_acquire);
+    const auto segments = SearchServer::AcquireSegments();
+    const auto [segment, ordinal] = SearchServer::LocateDocument(*segments, document_id);
+    if (segment == nullptr) throw out_of_range("Out of range"s);
+    // после изменения индекса в словаре могли появиться слова запроса, которых раньше не было
+    const Query query = prepared.epoch_ == epoch ? Query() : SearchServer::ParseQuery(prepared.raw_query_);
+    const Query& words = prepared.epoch_ == epoch ? prepared.query_ : query;
+    vector<string_view> matched_words;
+    for (const TermId word : words.minus_words) {
+        if (segment->Contains(word, ordinal)) {
+            return {matched_words, segment->GetStatus(ordinal)};
+        }
+    }
+    for (const TermId word : words.plus_words) {
+        if (segment->Contains(word, ordinal)) {
+            matched_words.push_back(dictionary_.GetTerm(word));
+        }
+    }
+    sort(matched_words.begin(), matched_words.end());
+    return {matched_words, segment->GetStatus(ordinal)};
+}
+
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const execution::sequenced_policy&,string_view raw_query, int document_id) const{
     return SearchServer::MatchDocument(raw_query, document_id);
 }
 
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const execution::parallel_policy&,  string_view raw_query, int document_id) const {
-    if (document_ids_.find(document_id) == document_ids_.end()) throw out_of_range("Out of range"s);
-   static auto query = SearchServer::ParseQuery(raw_query, true);
+    return SearchServer::MatchDocument(PoolExecutionPolicy(), raw_query, document_id);
+}
+
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const PoolExecutionPolicy& policy, string_view raw_query, int document_id) const {
+    const auto segments = SearchServer::AcquireSegments();
+    const auto location = SearchServer::LocateDocument(*segments, document_id);
+    const IndexSegment* segment = location.first;
+    const uint32_t ordinal = location.second;
+    if (segment == nullptr) throw out_of_range("Out of range"s);
+   const auto query = SearchServer::ParseQuery(raw_query, true);
   
-    if (any_of(execution::par, query.minus_words.begin(), query.minus_words.end(), [this, document_id](auto& word) {
-        return word_to_document_freqs_.at(SearchServer::ParseQueryWord(word).data).count(document_id); })) return { {}, documents_.at(document_id).status };
-        vector<string_view> matched_words(query.plus_words.size());
-       auto it= copy_if(execution::par, query.plus_words.begin(), query.plus_words.end(), matched_words.begin(), [this, &document_id](auto& word) {
-            return word_to_document_freqs_.at(word).count(document_id); });
-    sort(matched_words.begin(),it);
-    auto last = unique(matched_words.begin(), it);
-   
-        matched_words.erase(last, matched_words.end());
-        return { matched_words, documents_.at(document_id).status };
+    const auto pool = SearchServer::GetThreadPool();
+    atomic<bool> excluded{false};
+    pool->ParallelFor(query.minus_words.size(), policy.grain, [&query, &excluded, segment, ordinal](size_t i) {
+        if (!excluded.load(memory_order_relaxed) && segment->Contains(query.minus_words[i], ordinal)) {
+            excluded.store(true, memory_order_relaxed);
+        }
+    });
+    if (excluded.load()) return { vector<string_view>{}, segment->GetStatus(ordinal) };
+        vector<char> is_matched(query.plus_words.size());
+        pool->ParallelFor(query.plus_words.size(), policy.grain, [&query, &is_matched, segment, ordinal](size_t i) {
+            is_matched[i] = segment->Contains(query.plus_words[i], ordinal);
+        });
+        vector<TermId> matched_terms;
+        for (size_t i = 0; i < query.plus_words.size(); ++i) {
+            if (is_matched[i]) {
+                matched_terms.push_back(query.plus_words[i]);
+            }
+        }
+    sort(matched_terms.begin(), matched_terms.end());
+    matched_terms.erase(unique(matched_terms.begin(), matched_terms.end()), matched_terms.end());
+        vector<string_view> matched_words(matched_terms.size());
+        transform(matched_terms.begin(), matched_terms.end(), matched_words.begin(), [this](const TermId word) {
+            return dictionary_.GetTerm(word); });
+        sort(matched_words.begin(), matched_words.end());
+        return { matched_words, segment->GetStatus(ordinal) };
 }
 
-bool SearchServer::IsStopWord(const string& word) const {
+vector<SearchServer::matchtuple> SearchServer::MatchDocuments(string_view raw_query, const vector<int>& document_ids) const {
+    return SearchServer::MatchDocuments(execution::seq, raw_query, document_ids);
+}
+
+vector<SearchServer::matchtuple> SearchServer::MatchDocuments(const execution::sequenced_policy&, string_view raw_query, const vector<int>& document_ids) const {
+    return SearchServer::MatchDocumentsBatch(raw_query, document_ids, nullptr);
+}
+
+vector<SearchServer::matchtuple> SearchServer::MatchDocuments(const execution::parallel_policy&, string_view raw_query, const vector<int>& document_ids) const {
+    return SearchServer::MatchDocuments(PoolExecutionPolicy(), raw_query, document_ids);
+}
+
+vector<SearchServer::matchtuple> SearchServer::MatchDocuments(const PoolExecutionPolicy& policy, string_view raw_query, const vector<int>& document_ids) const {
+    return SearchServer::MatchDocumentsBatch(raw_query, document_ids, &policy);
+}
+
+vector<SearchServer::matchtuple> SearchServer::MatchDocumentsBatch(string_view raw_query, const vector<int>& document_ids, const PoolExecutionPolicy* policy) const {
+    const auto segments = SearchServer::AcquireSegments();
+    const auto query = SearchServer::ParseQuery(raw_query);
+    const size_t MIN_CHUNK_SIZE = 64;
+    size_t chunk_count = 1;
+    if (policy != nullptr && policy->grain > 0) {
+        chunk_count = max<size_t>(1, (document_ids.size() + policy->grain - 1) / policy->grain);
+    } else if (policy != nullptr) {
+        chunk_count = max<size_t>(1, min(SearchServer::GetThreadPool()->GetThreadCount() + 1, document_ids.size() / MIN_CHUNK_SIZE));
+    }
+
+    vector<pair<const IndexSegment*, uint32_t>> locations(document_ids.size());
+    ForEachIndex(chunk_count, chunk_count > 1, [&](size_t chunk) {
+        for (size_t i = document_ids.size() * chunk / chunk_count; i < document_ids.size() * (chunk + 1) / chunk_count; ++i) {
+            locations[i] = SearchServer::LocateDocument(*segments, document_ids[i]);
+        }
+    });
+    if (any_of(locations.begin(), locations.end(), [](const auto& location) {
+        return location.first == nullptr;
+    })) {
+        throw out_of_range("Out of range"s);
+    }
+
+    vector<matchtuple> result(document_ids.size());
+    ForEachIndex(chunk_count, chunk_count > 1, [&](size_t chunk) {
+        // документы части упорядочиваются по сегменту и номеру, и список документов
+        // каждого слова проходится по ним одним проходом с пропуском блоков
+        vector<size_t> order(document_ids.size() * (chunk + 1) / chunk_count - document_ids.size() * chunk / chunk_count);
+        iota(order.begin(), order.end(), document_ids.size() * chunk / chunk_count);
+        sort(order.begin(), order.end(), [&locations](size_t lhs, size_t rhs) {
+            return locations[lhs] < locations[rhs];
+        });
+        vector<bool> excluded(order.size());
+        for (size_t begin = 0; begin < order.size();) {
+            const IndexSegment* segment = locations[order[begin]].first;
+            size_t end = begin;
+            while (end < order.size() && locations[order[end]].first == segment) {
+                ++end;
+            }
+            const auto walk = [&](TermId word, auto on_match) {
+                const PostingList* postings = segment->FindPostings(word);
+                if (postings == nullptr) {
+                    return;
+                }
+                auto it = postings->begin();
+                for (size_t i = begin; i < end && it.IsValid(); ++i) {
+                    const uint32_t ordinal = locations[order[i]].second;
+                    it.SkipTo(ordinal);
+                    if (it.IsValid() && it.GetOrdinal() == ordinal) {
+                        on_match(i);
+                    }
+                }
+            };
+            for (const TermId word : query.minus_words) {
+                walk(word, [&excluded](size_t i) {
+                    excluded[i] = true;
+                });
+            }
+            for (const TermId word : query.plus_words) {
+                const string_view term = dictionary_.GetTerm(word);
+                walk(word, [&result, &order, &excluded, term](size_t i) {
+                    if (!excluded[i]) {
+                        get<0>(result[order[i]]).push_back(term);
+                    }
+                });
+            }
+            for (size_t i = begin; i < end; ++i) {
+                auto& [matched_words, status] = result[order[i]];
+                sort(matched_words.begin(), matched_words.end());
+                status = segment->GetStatus(locations[order[i]].second);
+            }
+            begin = end;
+        }
+    });
+    return result;
+}
+
+bool SearchServer::IsStopWord(string_view word) const {
         return stop_words_.count(word) > 0;
     }
 
-bool SearchServer::IsValidWord(const string& word) {
+bool SearchServer::IsValidWord(string_view word) {
         return none_of(word.begin(), word.end(), [](char c) {
             return c >= '\0' && c < ' ';
         });
     }
 
 
-vector<string> SearchServer::SplitIntoWordsNoStop(string_view text) const {
-        vector<string> words;
-        for (const string& word : SplitIntoWords(text)) {
-            if (!SearchServer::IsValidWord(word)) {
-                throw invalid_argument("Word "s + word + " is invalid"s);
-            }
-            if (!SearchServer::IsStopWord(word)) {
-                words.push_back(word);
-            }
+vector<string_view> SearchServer::SplitIntoWordsNoStop(string_view text) const {
+        vector<string_view> words;
+        const size_t invalid_word = SplitIntoWords(text, words);
+        if (invalid_word != words.size()) {
+            throw invalid_argument("Word "s + string(words[invalid_word]) + " is invalid"s);
         }
+        words.erase(remove_if(words.begin(), words.end(), [this](string_view word) {
+            return SearchServer::IsStopWord(word);
+        }), words.end());
         return words;
     }
 
@@ -127,18 +932,18 @@ int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
         return rating_sum / static_cast<int>(ratings.size());
     }
 
-SearchServer::QueryWord SearchServer::ParseQueryWord(const string& text) const {
+SearchServer::QueryWord SearchServer::ParseQueryWord(string_view text, bool is_valid) const {
         if (text.empty()) {
             throw invalid_argument("Query word is empty"s);
         }
-        string word = text;
+        string_view word = text;
         bool is_minus = false;
         if (word[0] == '-') {
             is_minus = true;
-            word = word.substr(1);
+            word.remove_prefix(1);
         }
-        if (word.empty() || word[0] == '-' || !IsValidWord(word)) {
-            throw invalid_argument("Query word "s + text + " is invalid");
+        if (word.empty() || word[0] == '-' || !is_valid) {
+            throw invalid_argument("Query word "s + string(text) + " is invalid");
         }
 
         return {word, is_minus, SearchServer::IsStopWord(word)};
@@ -147,15 +952,18 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(const string& text) const {
 
 SearchServer::Query SearchServer::ParseQuery(string_view text, bool par) const {
     SearchServer::Query result;
+    vector<string_view> words;
+    const size_t invalid_word = SplitIntoWords(text, words);
     if (!par){
         
-        for (const string& word : SplitIntoWords(text)) {
-            const auto query_word = SearchServer::ParseQueryWord(word);
-            if (!query_word.is_stop) {
+        for (size_t i = 0; i < words.size(); ++i) {
+            const auto query_word = SearchServer::ParseQueryWord(words[i], i != invalid_word);
+            const TermId term_id = query_word.is_stop ? INVALID_TERM_ID : dictionary_.Find(query_word.data);
+            if (term_id != INVALID_TERM_ID) {
                 if (query_word.is_minus) {
-                    result.minus_words.push_back(query_word.data);
+                    result.minus_words.push_back(term_id);
                 } else {
-                    result.plus_words.push_back(query_word.data);
+                    result.plus_words.push_back(term_id);
                 }
             }
         }
@@ -169,13 +977,14 @@ SearchServer::Query SearchServer::ParseQuery(string_view text, bool par) const {
     }
     else{
      
-        for (const string& word : SplitIntoWords(text)) {
-            const auto query_word = SearchServer::ParseQueryWord(word);
-            if (!query_word.is_stop) {
+        for (size_t i = 0; i < words.size(); ++i) {
+            const auto query_word = SearchServer::ParseQueryWord(words[i], i != invalid_word);
+            const TermId term_id = query_word.is_stop ? INVALID_TERM_ID : dictionary_.Find(query_word.data);
+            if (term_id != INVALID_TERM_ID) {
                 if (query_word.is_minus) {
-                    result.minus_words.push_back(query_word.data);
+                    result.minus_words.push_back(term_id);
                 } else {
-                    result.plus_words.push_back(query_word.data);
+                    result.plus_words.push_back(term_id);
                 }
             }
         }
@@ -183,64 +992,133 @@ SearchServer::Query SearchServer::ParseQuery(string_view text, bool par) const {
     }
     }
 
-double SearchServer::ComputeWordInverseDocumentFreq(const string& word) const {
-        return log(SearchServer::GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+vector<SearchServer::WeightedTerm> SearchServer::ComputeTermWeights(const SegmentList& segments, const Query& query,
+                                                                    const CorpusStatistics* statistics) const {
+    if (statistics == nullptr) {
+        statistics = corpus_statistics_.get();
     }
+    vector<WeightedTerm> words;
+    const size_t document_count = statistics ? statistics->GetDocumentCount() : SearchServer::CountDocuments(segments);
+    for (const TermId word : query.plus_words) {
+        // IDF считается по всем сегментам, как для единого индекса, удалённые документы не учитываются
+        size_t document_freq = 0;
+        if (statistics) {
+            document_freq = statistics->GetDocumentFrequency(dictionary_.GetTerm(word));
+        } else {
+            for (const auto& segment : segments.segments) {
+                document_freq += segment->CountDocuments(word);
+            }
+        }
+        if (document_freq > 0) {
+            words.push_back({word, log(document_count * 1.0 / document_freq)});
+        }
+    }
+    return words;
+}
 
+void SearchServer::ExcludeMinusWords(ScoreAccumulator& accumulator, const IndexSegment& segment, uint32_t first, uint32_t last, const Query& query) {
+    for (const TermId word : query.minus_words) {
+        const PostingList* postings = segment.FindPostings(word);
+        if (postings == nullptr) {
+            continue;
+        }
+        auto it = postings->begin();
+        it.SkipTo(first);
+        for (; it.IsValid() && it.GetOrdinal() < last; it.Next()) {
+            accumulator.Exclude(it.GetOrdinal() - first);
+        }
+    }
+}
 
+void SearchServer::CollectDocuments(const ScoreAccumulator& accumulator, const IndexSegment& segment, vector<Document>& matched_documents) {
+    accumulator.ForEachScored([&segment, &matched_documents](uint32_t ordinal, double relevance) {
+        matched_documents.push_back({segment.GetId(ordinal), relevance, segment.GetRating(ordinal)});
+    });
+}
 
-const map<string_view, double>& SearchServer::GetWordFrequencies(int document_id) const{
-    const static map<string_view,double> res;
-    if (find(SearchServer::begin(),SearchServer::end(),document_id)==SearchServer::end()){ 
-        return res;
+map<string_view, double> SearchServer::GetWordFrequencies(int document_id) const{
+    shared_lock guard(documents_mutex_);
+    map<string_view,double> res;
+    for (const TermFrequency& term : forward_index_.Find(document_id)) {
+        res.emplace(dictionary_.GetTerm(term.term_id), term.freq);
     }
-   else {
-       return id_to_word_freqs_.at(document_id);
-   }
     return res;
 }
 
+DocumentTerms SearchServer::GetDocumentTerms(int document_id) const {
+    shared_lock guard(documents_mutex_);
+    return forward_index_.Find(document_id);
+}
+
 void SearchServer::RemoveDocument(int document_id){
-    if (document_ids_.find(document_id)==document_ids_.end()) return;
-    for (auto [word, _] : id_to_word_freqs_.at(document_id))
- {
-           auto it = word_to_document_freqs_.find(word);
-        if (it != word_to_document_freqs_.end()) {
-            it->second.erase(document_id);
-            if (it->second.empty()) {
-                word_to_document_freqs_.erase(it);
+    unique_lock write_lock(write_mutex_);
+    if (!forward_index_.Contains(document_id)) return;
+    const DocumentTerms word_freqs = forward_index_.Find(document_id);
+    vector<TermId> terms;
+    terms.reserve(word_freqs.size());
+    for (const TermFrequency& term : word_freqs) {
+        terms.push_back(term.term_id);
+    }
+    if (duplicate_policy_ != DuplicatePolicy::ALLOW) {
+        const auto [first, last] = fingerprints_.equal_range(ComputeFingerprint(word_freqs));
+        for (auto it = first; it != last; ++it) {
+            if (it->second == document_id) {
+                fingerprints_.erase(it);
+                break;
             }
         }
     }
-    id_to_word_freqs_.erase(document_id);
-    documents_.erase(document_id);
-    document_ids_.erase(document_id);
-        
+    // документ только помечается, набор сегментов не меняется
+    const auto segments = SearchServer::AcquireSegments();
+    const auto [segment, ordinal] = SearchServer::LocateDocument(*segments, document_id);
+    segment->MarkRemoved(ordinal, terms);
+    index_epoch_.fetch_add(1, memory_order_release);
+    const bool needs_compaction = segment->removed_count() * COMPACTION_RATIO >= segment->size();
+    if (merging_) {
+        merge_removals_.emplace_back(document_id, move(terms));
+    }
+    {
+        unique_lock near_guard(near_duplicates_mutex_, defer_lock);
+        if (near_duplicate_index_) {
+            near_guard.lock();
+            near_duplicate_index_->Remove(document_id);
+        }
+        unique_lock guard(documents_mutex_);
+        forward_index_.Remove(document_id);
+        document_ids_.erase(document_id);
+        flagged_duplicates_.erase(document_id);
+    }
+    if (needs_compaction) {
+        SearchServer::WakeMerges();
+    }
+}
+
+void SearchServer::Compact() {
+    lock_guard write_guard(write_mutex_);
+    auto segments = make_shared<SegmentList>();
+    const auto current = SearchServer::AcquireSegments();
+    for (const auto& segment : current->segments) {
+        if (segment->removed_count() == 0) {
+            segments->segments.push_back(segment);
+        } else if (segment->live_size() > 0) {
+            segments->segments.push_back(IndexSegment::Merge({segment.get()}));
+        }
+    }
+    SearchServer::PublishSegments(move(segments));
+    merge_condition_.notify_all();
+    unique_lock near_guard(near_duplicates_mutex_);
+    unique_lock guard(documents_mutex_);
+    forward_index_.Compact();
 }
 
 
 void SearchServer::RemoveDocument(const std::execution::parallel_policy&, int document_id){
-    if (document_ids_.find(document_id)==document_ids_.end()) return;
-    std::vector<const std::string_view*> to_delete(id_to_word_freqs_.at(document_id).size());
-    
-    transform( id_to_word_freqs_.at(document_id).begin(),id_to_word_freqs_.at(document_id).end(),to_delete.begin(),[](auto& mapa){return &mapa.first;});
-    for_each(std::execution::par,to_delete.begin(),to_delete.end(),[this, &document_id](auto& word) {
-        auto it = word_to_document_freqs_.find(*word);
-        if (it != word_to_document_freqs_.end()) {
-            it->second.erase(document_id);
-          
-        }
-    });
-     for_each(to_delete.begin(),to_delete.end(),[this, &document_id](auto& word){
-         auto it = word_to_document_freqs_.find(*word);
-        if (it != word_to_document_freqs_.end())
-         
-                word_to_document_freqs_.erase(it);
-         
-     });
-    id_to_word_freqs_.erase(document_id);
-    documents_.erase(document_id);
-    document_ids_.erase(document_id);
+    SearchServer::RemoveDocument(document_id);
+}
+
+// удаление только ставит метки, параллелить в нём нечего
+void SearchServer::RemoveDocument(const PoolExecutionPolicy&, int document_id) {
+    SearchServer::RemoveDocument(document_id);
 }
 
 void SearchServer::RemoveDocument(const std::execution::sequenced_policy&, int document_id){
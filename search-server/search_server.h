@@ -2,12 +2,23 @@
 #include "document.h"
 #include "string_processing.h"
 #include "read_input_functions.h"
+#include "term_dictionary.h"
+#include "posting_list.h"
+#include "top_documents.h"
+#include "score_accumulator.h"
+#include "block_max_wand.h"
+#include "cow_array.h"
+#include "snapshot_io.h"
+#include "index_segment.h"
+#include "query_cache.h"
+#include "forward_index.h"
+#include "near_duplicates.h"
+#include "thread_pool.h"
 #include <algorithm>
 #include <stdexcept>
 #include <vector>
 #include <set>
 #include <map>
-#include <deque>
 #include <iostream>
 #include <string>
 #include <execution>
@@ -15,13 +26,85 @@
 #include <type_traits>
 #include <utility>
 #include <tuple>
+#include <unordered_map>
 #include <iterator>
+#include <memory>
 #include <string_view>
-#include "concurrent_map.h"
+#include <numeric>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
-const double EPSILON=1e-6;
 
+// Параллельный поиск делит документы на диапазоны: по RANGES_PER_THREAD на поток,
+// но не короче MIN_RANGE_SIZE.
+const size_t RANGES_PER_THREAD = 4;
+const size_t MIN_RANGE_SIZE = 4096;
+
+// Поиск по статусу идёт от маски статуса, а не от списка слова, если документов
+// со статусом в сегменте меньше длины списка в STATUS_SKIP_RATIO раз.
+const size_t STATUS_SKIP_RATIO = 8;
+
+// глубина выдачи FindTopDocuments: документы с позиций [offset, offset + top_k)
+class CorpusStatistics;
+
+struct SearchOptions {
+    size_t top_k = MAX_RESULT_DOCUMENT_COUNT;
+    size_t offset = 0;
+    // Block-Max WAND вместо полного перебора: выдача та же, но документы, которые
+    // не могут попасть в top, не оцениваются. Выполняется в одном потоке.
+    bool dynamic_pruning = false;
+    // IDF этого запроса считается по corpus_statistics вместо заданной SetCorpusStatistics;
+    // такой запрос не идёт через кэш. Подготовленным запросам IDF считает PrepareQuery.
+    const CorpusStatistics* corpus_statistics = nullptr;
+};
+
+// Что AddDocument делает с документом, набор слов которого совпадает с набором документа,
+// уже лежащего в индексе
+enum class DuplicatePolicy {
+    ALLOW,    // добавляет без проверки
+    REJECT,   // бросает invalid_argument, документ не добавляется
+    FLAG,     // добавляет и запоминает, чей это дубликат
+};
+
+// Предикат "документ со статусом status". Поиск узнаёт этот тип при компиляции и вместо
+// вызова предиката для каждого документа пересекает списки слов с маской статуса сегмента.
+struct StatusPredicate {
+    DocumentStatus status;
+
+    bool operator()(int, DocumentStatus document_status, int) const {
+        return document_status == status;
+    }
+};
+
+template <typename DocumentPredicate>
+constexpr bool IS_STATUS_PREDICATE = std::is_same_v<std::remove_cv_t<DocumentPredicate>, StatusPredicate>;
+
+// Статистика корпуса, по которой считается IDF. Нужна, когда корпус разбит на несколько
+// серверов, а релевантность должна быть такой же, как у одного сервера со всеми документами.
+// Методы вызываются из потоков запросов одновременно.
+class CorpusStatistics {
+public:
+    virtual ~CorpusStatistics() = default;
+
+    // без удалённых
+    virtual size_t GetDocumentCount() const = 0;
+    virtual size_t GetDocumentFrequency(std::string_view word) const = 0;
+};
+
+// Индекс разбит на неизменяемые сегменты. Запрос читает набор сегментов, опубликованный
+// к его началу, поэтому поиск, MatchDocument, GetWordFrequencies и GetDocumentCount можно
+// вызывать из любых потоков одновременно с AddDocument и RemoveDocument: запрос не видит
+// только ту запись, которая ещё не завершилась. Записи выполняются по одной.
+// Параллельные перегрузки (execution::par и PoolExecutionPolicy) выполняются на пуле
+// потоков сервера, в том числе когда их вызывают из задач этого же пула.
+// Сервер владеет мьютексами, атомарными счётчиками и потоком фоновых слияний, поэтому его
+// нельзя ни копировать, ни перемещать: он живёт там, где создан, а передаётся по ссылке
+// или в unique_ptr. OpenSnapshot возвращает сервер по значению только благодаря
+// обязательному пропуску копирования (C++17): результат нужно сразу инициализировать им.
 class SearchServer {
 public:
     template <typename StringContainer>
@@ -30,27 +113,102 @@ public:
     explicit SearchServer(const std::string& stop_words_text);
     
     explicit SearchServer(const std::string_view stop_words_text);
+
+    ~SearchServer();
+
+    SearchServer(const SearchServer&) = delete;
+    SearchServer& operator=(const SearchServer&) = delete;
   
     
     void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
 
+    // Разбор на слова и частичные индексы строятся параллельно по частям пакета, затем
+    // сливаются в основной индекс. Ошибки те же, что у AddDocument (о первом по порядку
+    // неверном документе), но при ошибке не добавляется ни один документ пакета.
+    void AddDocuments(const std::vector<DocumentInput>& documents);
+    template <typename ExecutionPolicy>
+    void AddDocuments(const ExecutionPolicy& policy, const std::vector<DocumentInput>& documents);
+
     template <typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(std::string_view raw_query,DocumentPredicate document_predicate) const;
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query,DocumentPredicate document_predicate, const SearchOptions& options) const;
     std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status, const SearchOptions& options) const;
     std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, const SearchOptions& options) const;
+    // То же через кэш выдачи, но выдача пишется в result, и его память переиспользуется:
+    // при попадании в кэш она копируется прямо в result, при промахе считается в нём.
+    void FindTopDocuments(std::string_view raw_query, const SearchOptions& options, std::vector<Document>& result) const;
     
 
     template <typename DocumentPredicate, typename ExecutionPolicy>
     std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query,DocumentPredicate document_predicate) const;
+    template <typename DocumentPredicate, typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query,DocumentPredicate document_predicate, const SearchOptions& options) const;
     
     template <typename ExecutionPolicy>
     std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentStatus status) const;
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentStatus status, const SearchOptions& options) const;
     
     template <typename ExecutionPolicy>
     std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query) const;
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, const SearchOptions& options) const;
+
+    // Запрос, разобранный заранее: выполнение не разбирает текст и не ищет слова в словаре.
+    // Годится только для сервера, который его подготовил.
+    class PreparedQuery;
+    PreparedQuery PrepareQuery(std::string_view raw_query) const;
+
+    std::vector<Document> FindTopDocuments(const PreparedQuery& query) const;
+    std::vector<Document> FindTopDocuments(const PreparedQuery& query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(const PreparedQuery& query, DocumentStatus status, const SearchOptions& options) const;
+    // Выдача пишется в result, и его память переиспользуется. Без dynamic_pruning,
+    // пока индекс не меняется и result вмещает выдачу, вызов не выделяет память.
+    template <typename DocumentPredicate>
+    void FindTopDocuments(const PreparedQuery& query, DocumentPredicate document_predicate, const SearchOptions& options,
+                          std::vector<Document>& result) const;
     
     int GetDocumentCount() const;
+
+    // число неудалённых документов сервера со словом
+    size_t GetDocumentFrequency(std::string_view word) const;
+
+    // IDF считается по statistics вместо документов сервера (nullptr - по своим).
+    // Задаётся до первого запроса. Пока статистика задана, запросы не идут через кэш;
+    // подготовленные запросы об её изменениях не знают.
+    void SetCorpusStatistics(std::shared_ptr<const CorpusStatistics> statistics);
+
+    // Проверка дубликатов при добавлении, по умолчанию ALLOW. При включении строятся отпечатки
+    // наборов слов всех документов, дальше их поддерживают добавление и удаление. В пакете
+    // AddDocuments документ сверяется и с предыдущими документами пакета.
+    void SetDuplicatePolicy(DuplicatePolicy policy);
+    // для FLAG: id дубликата -> id документа с тем же набором слов, найденного при добавлении
+    std::map<int, int> GetFlaggedDuplicates() const;
+
+    // Индекс почти-дубликатов (near_duplicates.h), по умолчанию выключен. При включении в него
+    // попадают все документы сервера, дальше его поддерживают добавление и удаление;
+    // повторное включение перестраивает индекс с новыми options.
+    void EnableNearDuplicateIndex(const NearDuplicateOptions& options = NearDuplicateOptions());
+    void DisableNearDuplicateIndex();
+    // документы, похожие на документ сервера, по возрастанию id; пусто, если индекс выключен
+    // или документа нет. Можно вызывать одновременно с записью.
+    std::vector<int> FindSimilarDocuments(int document_id) const;
+
+    // Размер пула для параллельных перегрузок, 0 - по числу ядер. Пул создаётся при первом
+    // параллельном вызове; вызовы, начатые до смены размера, дорабатывают на прежнем пуле.
+    void SetThreadCount(size_t thread_count);
+    std::shared_ptr<ThreadPool> GetThreadPool() const;
+
+    // Кэш выдачи запросов по статусу (с предикатом-функцией запросы идут мимо кэша).
+    // Ключ - разобранный запрос, статус и глубина выдачи; любое добавление или удаление
+    // документа делает прежние записи недействительными. По умолчанию кэш выключен.
+    void SetQueryCacheBudget(size_t byte_budget);
+    QueryCacheStats GetQueryCacheStats() const;
     
+    // обход id не защищён от одновременной записи
     std::set<int>::const_iterator begin() const{
         return document_ids_.begin();
     }
@@ -64,12 +222,37 @@ public:
     matchtuple MatchDocument(std::string_view raw_query, int document_id) const;
     matchtuple MatchDocument(const std::execution::sequenced_policy&,std::string_view raw_query, int document_id) const;
     matchtuple MatchDocument(const std::execution::parallel_policy&,std::string_view raw_query, int document_id) const;
+    matchtuple MatchDocument(const PoolExecutionPolicy& policy, std::string_view raw_query, int document_id) const;
+    matchtuple MatchDocument(const PreparedQuery& query, int document_id) const;
+
+    // MatchDocument для многих документов: запрос разбирается один раз, ответы идут в порядке
+    // document_ids. out_of_range, если хотя бы одного документа нет.
+    std::vector<matchtuple> MatchDocuments(std::string_view raw_query, const std::vector<int>& document_ids) const;
+    std::vector<matchtuple> MatchDocuments(const std::execution::sequenced_policy&, std::string_view raw_query, const std::vector<int>& document_ids) const;
+    std::vector<matchtuple> MatchDocuments(const std::execution::parallel_policy&, std::string_view raw_query, const std::vector<int>& document_ids) const;
+    std::vector<matchtuple> MatchDocuments(const PoolExecutionPolicy& policy, std::string_view raw_query, const std::vector<int>& document_ids) const;
     
-    const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+    // совместимость: строит map по GetDocumentTerms
+    std::map<std::string_view, double> GetWordFrequencies(int document_id) const;
+    // Слова документа (id слов по возрастанию) и их частоты без копирования; пустой вид,
+    // если документа нет. Вид действителен до следующего RemoveDocument или Compact: удаление
+    // может перепаковать прямой индекс.
+    DocumentTerms GetDocumentTerms(int document_id) const;
     
     void RemoveDocument(int document_id);
     void RemoveDocument(const std::execution::sequenced_policy&, int document_id);
     void RemoveDocument(const std::execution::parallel_policy&, int document_id);
+    void RemoveDocument(const PoolExecutionPolicy&, int document_id);
+
+    // Удаление только помечает документ в его сегменте; списки документов чистятся при
+    // слиянии или в фоне, когда в сегменте удалена заметная доля документов.
+    // Compact сразу перестраивает все сегменты с удалёнными документами и прямой индекс.
+    void Compact();
+
+    // Снимок индекса на диске: словарь, списки документов, прямой индекс и данные документов.
+    // OpenSnapshot отображает файл в память, и запросы читают списки прямо из него.
+    void SaveSnapshot(const std::string& path) const;
+    static SearchServer OpenSnapshot(const std::string& path);
     
     void GetStopWords(){
         for (auto word : stop_words_){
@@ -78,58 +261,192 @@ public:
     }
 
 private:
-    struct DocumentData {
-        int rating;
-        DocumentStatus status;
+    // Набор сегментов, который видят запросы. Запись и слияние собирают новый набор и
+    // публикуют его атомарно; запрос держит shared_ptr на набор, взятый в начале,
+    // поэтому сегменты живут, пока их кто-то читает.
+    struct SegmentList {
+        std::vector<std::shared_ptr<const IndexSegment>> segments;
+    };
+
+    // сегменты [first, first + count) заменяются одним; count == 0 - заменять нечего
+    struct MergeRange {
+        size_t first = 0;
+        size_t count = 0;
     };
-    std::deque<std::string> words_;
-    const std::set<std::string> stop_words_;
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-    std::map<int, DocumentData> documents_;
+
+    const std::set<std::string, std::less<>> stop_words_;
+    TermDictionary dictionary_;
+    std::shared_ptr<const SegmentList> segments_ = std::make_shared<const SegmentList>();   // только через AcquireSegments/PublishSegments
+    mutable ScoreAccumulatorPool accumulator_pool_;
+    mutable QueryCache query_cache_;
+    // растёт после каждого изменения выдачи: добавления или удаления документов
+    std::atomic<uint64_t> index_epoch_{0};
+    std::shared_ptr<const CorpusStatistics> corpus_statistics_;
+    // id и прямой индекс меняются под documents_mutex_
     std::set<int> document_ids_;         //set
-    std::map<int ,std::map<std::string_view, double>> id_to_word_freqs_;
+    ForwardIndex forward_index_;
+    std::map<int, int> flagged_duplicates_;
+    mutable std::shared_mutex documents_mutex_;
+    std::shared_ptr<const MappedFile> snapshot_file_;
+    // запись и замена сегментов после слияния идут под write_mutex_
+    mutable std::mutex write_mutex_;
+    // отпечатки документов для проверки дубликатов (пусто при ALLOW), меняются под write_mutex_
+    DuplicatePolicy duplicate_policy_ = DuplicatePolicy::ALLOW;
+    std::unordered_multimap<TermSetFingerprint, int, TermSetFingerprintHash> fingerprints_;
+    // Меняется под write_mutex_ и near_duplicates_mutex_. Поиск похожих держит виды прямого
+    // индекса, поэтому удаление и Compact перепаковывают его под near_duplicates_mutex_.
+    // Порядок: write_mutex_, near_duplicates_mutex_, documents_mutex_.
+    std::unique_ptr<NearDuplicateIndex> near_duplicate_index_;
+    mutable std::shared_mutex near_duplicates_mutex_;
+    std::condition_variable merge_condition_;
+    std::thread merge_thread_;
+    bool stop_merges_ = false;
+    // пока фоновое слияние идёт без блокировки, удаления запоминаются (id и слова документа),
+    // чтобы пометить их и в новом сегменте
+    bool merging_ = false;
+    std::vector<std::pair<int, std::vector<TermId>>> merge_removals_;
+    mutable std::mutex thread_pool_mutex_;
+    mutable std::shared_ptr<ThreadPool> thread_pool_;   // только через GetThreadPool
+    size_t thread_count_ = 0;
+
+    SearchServer(std::shared_ptr<const MappedFile> snapshot_file, SnapshotReader reader);
+
+    // chunk_count == 1 - в вызывающем потоке, иначе на пуле
+    void AddDocumentsBatch(const std::vector<DocumentInput>& documents, size_t chunk_count);
+
+    template <typename ExecutionPolicy>
+    static PoolExecutionPolicy ToPoolPolicy(const ExecutionPolicy& policy);
+
+    // function(index) для index из [0, count): на пуле, если parallel, иначе по порядку
+    template <typename Function>
+    void ForEachIndex(size_t count, bool parallel, Function function) const;
+
+    std::shared_ptr<const SegmentList> AcquireSegments() const {
+        return std::atomic_load(&segments_);
+    }
+
+    void PublishSegments(std::shared_ptr<const SegmentList> segments);
+
+    void AppendSegment(std::unique_lock<std::mutex>& write_lock, std::shared_ptr<const IndexSegment> segment);
 
-    bool IsStopWord(const std::string& word) const;
+    static MergeRange FindMergeCandidate(const SegmentList& segments);
 
-    static bool IsValidWord(const std::string& word);
+    // запускает фоновый поток слияний, если он ещё не запущен
+    void WakeMerges();
 
-    std::vector<std::string> SplitIntoWordsNoStop(const std::string& text) const;
-    std::vector<std::string> SplitIntoWordsNoStop(std::string_view text) const;
+    void RunMerges();
+
+    // сегмент с документом и номер документа в нём; nullptr, если документа нет
+    static std::pair<const IndexSegment*, uint32_t> LocateDocument(const SegmentList& segments, int document_id);
+
+    // без удалённых
+    static size_t CountDocuments(const SegmentList& segments);
+
+    // id документа индекса с тем же набором слов или -1; вызывается под write_mutex_
+    int FindDuplicate(const TermSetFingerprint& fingerprint, DocumentTerms terms) const;
+
+    // policy == nullptr - в вызывающем потоке
+    std::vector<matchtuple> MatchDocumentsBatch(std::string_view raw_query, const std::vector<int>& document_ids, const PoolExecutionPolicy* policy) const;
+
+    bool IsStopWord(std::string_view word) const;
+
+    static bool IsValidWord(std::string_view word);
+
+    // слова ссылаются на text
+    std::vector<std::string_view> SplitIntoWordsNoStop(std::string_view text) const;
 
     static int ComputeAverageRating(const std::vector<int>& ratings);
 
     struct QueryWord {
-        std::string data;
+        std::string_view data;
         bool is_minus;
         bool is_stop;
     };
 
-    QueryWord ParseQueryWord(const std::string& text) const;
+    // is_valid - нет управляющих символов, проверяется при разбиении запроса на слова
+    QueryWord ParseQueryWord(std::string_view text, bool is_valid) const;
 
+    // слова, которых нет в словаре, ни с одним документом не совпадут и в запрос не попадают
     struct Query {
-        std::vector<std::string> plus_words;
-        std::vector<std::string> minus_words;
+        std::vector<TermId> plus_words;
+        std::vector<TermId> minus_words;
     };
 
     
     Query ParseQuery(std::string_view text, bool par=false) const;
 
+    // плюс-слово запроса с IDF по всем сегментам
+    struct WeightedTerm {
+        TermId term_id;
+        double inverse_document_freq;
+    };
 
+    // слова без документов отбрасываются; statistics == nullptr - статистика сервера
+    std::vector<WeightedTerm> ComputeTermWeights(const SegmentList& segments, const Query& query,
+                                                 const CorpusStatistics* statistics = nullptr) const;
     
-    double ComputeWordInverseDocumentFreq(const std::string& word) const;
-    
+    // Обе функции обходят документы сегмента с номерами [first, last); в аккумуляторе
+    // документ лежит под номером ordinal - first.
     template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const Query& query,
-     DocumentPredicate document_predicate) const;
+    static void AccumulateRelevance(ScoreAccumulator& accumulator, const IndexSegment& segment, uint32_t first, uint32_t last,
+     const WeightedTerm& word, DocumentPredicate& document_predicate);
+
+    // вызывается до AccumulateRelevance: документы с минус-словами потом не оцениваются
+    static void ExcludeMinusWords(ScoreAccumulator& accumulator, const IndexSegment& segment, uint32_t first, uint32_t last, const Query& query);
+
+    static void CollectDocuments(const ScoreAccumulator& accumulator, const IndexSegment& segment, std::vector<Document>& matched_documents);
+
+    template <typename DocumentPredicate, typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, const SegmentList& segments, const Query& query,
+     DocumentPredicate document_predicate, const SearchOptions& options) const;
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindAllDocuments(const SegmentList& segments, const Query& query,
+     DocumentPredicate document_predicate, const CorpusStatistics* statistics) const;
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocumentsWithPruning(const SegmentList& segments, const Query& query,
+     DocumentPredicate document_predicate, const SearchOptions& options) const;
+
+    // сегменты обходятся по очереди с общей кучей top
+    template <typename DocumentPredicate>
+    static void CollectTopDocumentsWithPruning(const SegmentList& segments, const std::vector<WeightedTerm>& words, const Query& query,
+     DocumentPredicate& document_predicate, TopDocuments& top);
+
+    PreparedQuery PrepareQuery(const SegmentList& segments, std::string_view raw_query, uint64_t epoch) const;
+
+    template <typename DocumentPredicate>
+    void FindPreparedDocuments(const SegmentList& segments, const PreparedQuery& query, DocumentPredicate& document_predicate,
+     const SearchOptions& options, std::vector<Document>& result) const;
     
     
+    // Параллельный поиск по диапазонам номеров документов: каждая задача считает все слова
+    // запроса для своего диапазона в свой аккумулятор и отбирает свой top, затем top сливаются.
+    // Сумма релевантности документа складывается в том же порядке, что и в одном потоке.
     template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const std::execution::parallel_policy&, const Query& query,
-     DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocumentsByRanges(const PoolExecutionPolicy& policy, const SegmentList& segments, const Query& query,
+     DocumentPredicate document_predicate, const SearchOptions& options) const;
 };
     
  
 
+// Слова запроса и их IDF при эпохе индекса epoch_. Если при выполнении эпоха другая,
+// IDF устарел и запрос разбирается заново по raw_query_.
+class SearchServer::PreparedQuery {
+public:
+    const std::string& GetRawQuery() const {
+        return raw_query_;
+    }
+
+private:
+    friend class SearchServer;
+
+    std::string raw_query_;
+    Query query_;
+    std::vector<WeightedTerm> words_;
+    uint64_t epoch_ = 0;
+};
+
  template <typename StringContainer>
   SearchServer::SearchServer(const StringContainer& stop_words)
         : stop_words_(MakeUniqueNonEmptyStrings(stop_words)) 
@@ -140,136 +457,306 @@ private:
         }
     }
     
+template <typename ExecutionPolicy>
+    void SearchServer::AddDocuments(const ExecutionPolicy& policy, const std::vector<DocumentInput>& documents) {
+    if constexpr (std::is_same_v<ExecutionPolicy,std::execution::sequenced_policy>) {
+        SearchServer::AddDocumentsBatch(documents, 1);
+    } else {
+        const size_t grain = SearchServer::ToPoolPolicy(policy).grain;
+        SearchServer::AddDocumentsBatch(documents, grain > 0 ? (documents.size() + grain - 1) / grain : SearchServer::GetThreadPool()->GetThreadCount() + 1);
+    }
+    }
+
+template <typename ExecutionPolicy>
+    PoolExecutionPolicy SearchServer::ToPoolPolicy(const ExecutionPolicy& policy) {
+    if constexpr (std::is_same_v<ExecutionPolicy, PoolExecutionPolicy>) {
+        return policy;
+    } else {
+        return PoolExecutionPolicy();
+    }
+    }
+
 template <typename DocumentPredicate>
     std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query,DocumentPredicate document_predicate) const {
-    using namespace std;
-        const auto query = SearchServer::ParseQuery(raw_query);
-
-        auto matched_documents = SearchServer::FindAllDocuments(query, document_predicate);
-
-        sort(matched_documents.begin(), matched_documents.end(),
-             [](const Document& lhs, const Document& rhs) {
-                 if (abs(lhs.relevance - rhs.relevance) < EPSILON) {
-                     return lhs.rating > rhs.rating;
-                 } else {
-                     return lhs.relevance > rhs.relevance;
-                 }
-             });
-        if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-            matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-        }
+        return SearchServer::FindTopDocuments(std::execution::seq, raw_query, document_predicate, SearchOptions());
+    }
 
-        return matched_documents;
+template <typename DocumentPredicate>
+    std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query,DocumentPredicate document_predicate, const SearchOptions& options) const {
+        return SearchServer::FindTopDocuments(std::execution::seq, raw_query, document_predicate, options);
     }
 
 template <typename DocumentPredicate, typename ExecutionPolicy>
     std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query,DocumentPredicate document_predicate) const{
-    using namespace std;
-    if (std::is_same_v<ExecutionPolicy,std::execution::sequenced_policy>) return SearchServer::FindTopDocuments(raw_query, document_predicate);
-        const auto query = SearchServer::ParseQuery(raw_query);
+        return SearchServer::FindTopDocuments(policy, raw_query, document_predicate, SearchOptions());
+    }
 
-        auto matched_documents = SearchServer::FindAllDocuments(execution::par, query, document_predicate);
-
-        sort(matched_documents.begin(), matched_documents.end(),
-             [](const Document& lhs, const Document& rhs) {
-                 if (abs(lhs.relevance - rhs.relevance) < EPSILON) {
-                     return lhs.rating > rhs.rating;
-                 } else {
-                     return lhs.relevance > rhs.relevance;
-                 }
-             });
-        if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-            matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-        }
+template <typename DocumentPredicate, typename ExecutionPolicy>
+    std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query,DocumentPredicate document_predicate, const SearchOptions& options) const{
+        // весь запрос выполняется по набору сегментов, опубликованному к его началу
+        const auto segments = SearchServer::AcquireSegments();
+        const auto query = SearchServer::ParseQuery(raw_query);
+        return SearchServer::FindTopDocuments(policy, *segments, query, document_predicate, options);
+    }
 
-        return matched_documents;
+template <typename DocumentPredicate, typename ExecutionPolicy>
+    std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, const SearchServer::SegmentList& segments, const SearchServer::Query& query,
+     DocumentPredicate document_predicate, const SearchOptions& options) const {
+    if (options.dynamic_pruning) {
+        return SearchServer::FindTopDocumentsWithPruning(segments, query, document_predicate, options);
+    }
+    if constexpr (std::is_same_v<ExecutionPolicy,std::execution::sequenced_policy>) {
+        return SelectTopDocuments(SearchServer::FindAllDocuments(segments, query, document_predicate, options.corpus_statistics), options.top_k, options.offset);
+    } else {
+        return SearchServer::FindTopDocumentsByRanges(SearchServer::ToPoolPolicy(policy), segments, query, document_predicate, options);
+    }
     }
     
 
      template <typename ExecutionPolicy>
     std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentStatus status) const{
-    if (std::is_same_v<ExecutionPolicy,std::execution::sequenced_policy>) return SearchServer::FindTopDocuments(raw_query, status);
-    return SearchServer::FindTopDocuments(std::execution::par,
-            raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-                return document_status == status;
-            });
+    return SearchServer::FindTopDocuments(policy, raw_query, status, SearchOptions());
+    }
+
+     template <typename ExecutionPolicy>
+    std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, DocumentStatus status, const SearchOptions& options) const{
+    const StatusPredicate document_predicate{status};
+    if (!query_cache_.IsEnabled() || options.corpus_statistics != nullptr || corpus_statistics_ != nullptr) {
+        return SearchServer::FindTopDocuments(policy, raw_query, document_predicate, options);
+    }
+    // эпоха читается раньше набора сегментов: если между ними прошла запись,
+    // выдача по новым сегментам запишется со старой эпохой и просто не будет найдена
+    const uint64_t epoch = index_epoch_.load(std::memory_order_acquire);
+    const auto segments = SearchServer::AcquireSegments();
+    const auto query = SearchServer::ParseQuery(raw_query);
+    QueryCacheKey key{query.plus_words, query.minus_words, status, options.top_k, options.offset};
+    std::vector<Document> documents;
+    if (query_cache_.Find(key, epoch, documents)) {
+        return documents;
+    }
+    documents = SearchServer::FindTopDocuments(policy, *segments, query, document_predicate, options);
+    query_cache_.Insert(std::move(key), epoch, documents);
+    return documents;
     }
     
     template <typename ExecutionPolicy>
     std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query) const{
-    if (std::is_same_v<ExecutionPolicy,std::execution::sequenced_policy>) return SearchServer::FindTopDocuments(raw_query);
-    return SearchServer::FindTopDocuments(std::execution::par, raw_query, DocumentStatus::ACTUAL);
+    return SearchServer::FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
+    }
+
+    template <typename ExecutionPolicy>
+    std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, const SearchOptions& options) const{
+    return SearchServer::FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL, options);
     }
 
 
 
 
 template <typename DocumentPredicate>
-    std::vector<Document> SearchServer::FindAllDocuments(const SearchServer::Query& query,
-     DocumentPredicate document_predicate) const {
-    using namespace std;
-       map<int, double> document_to_relevance;
-   
-        for (const string& word : query.plus_words) {
-            if (word_to_document_freqs_.count(word) == 0) {
-                continue;
+    void SearchServer::AccumulateRelevance(ScoreAccumulator& accumulator, const IndexSegment& segment, uint32_t first, uint32_t last,
+     const WeightedTerm& word, DocumentPredicate& document_predicate) {
+        const PostingList* postings = segment.FindPostings(word.term_id);
+        if (postings == nullptr) {
+            return;
+        }
+        if constexpr (IS_STATUS_PREDICATE<DocumentPredicate>) {
+            const DocumentStatus status = document_predicate.status;
+            const size_t status_count = segment.CountStatus(status);
+            if (status_count == 0) {
+                return;
             }
-            const double inverse_document_freq = SearchServer::ComputeWordInverseDocumentFreq(word);
-            for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-                const auto& document_data = documents_.at(document_id);
-                if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                    document_to_relevance[document_id] += term_freq * inverse_document_freq;
+            if (status_count * STATUS_SKIP_RATIO < postings->size()) {
+                // документов со статусом мало: список слова проходится пропусками к ним
+                auto it = postings->begin();
+                segment.ForEachWithStatus(status, first, last, [&](uint32_t ordinal) {
+                    if (!it.IsValid()) {
+                        return;
+                    }
+                    it.SkipTo(ordinal);
+                    if (it.IsValid() && it.GetOrdinal() == ordinal && !segment.IsRemoved(ordinal)) {
+                        accumulator.Add(ordinal - first, segment.ComputeTermFreq(ordinal, it.GetCount()) * word.inverse_document_freq);
+                    }
+                });
+            } else {
+                auto it = postings->begin();
+                it.SkipTo(first);
+                for (; it.IsValid() && it.GetOrdinal() < last; it.Next()) {
+                    const uint32_t ordinal = it.GetOrdinal();
+                    if (segment.HasStatus(ordinal, status) && !segment.IsRemoved(ordinal)) {
+                        accumulator.Add(ordinal - first, segment.ComputeTermFreq(ordinal, it.GetCount()) * word.inverse_document_freq);
+                    }
                 }
             }
+            return;
         }
- 
-
-        for (const string& word : query.minus_words) {
-            if (word_to_document_freqs_.count(word) == 0) {
+        auto it = postings->begin();
+        it.SkipTo(first);
+        for (; it.IsValid() && it.GetOrdinal() < last; it.Next()) {
+            const uint32_t ordinal = it.GetOrdinal();
+            if (segment.IsRemoved(ordinal)) {
                 continue;
             }
-            for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-                document_to_relevance.erase(document_id);
+            if (document_predicate(segment.GetId(ordinal), segment.GetStatus(ordinal), segment.GetRating(ordinal))) {
+                accumulator.Add(ordinal - first, segment.ComputeTermFreq(ordinal, it.GetCount()) * word.inverse_document_freq);
             }
         }
+    }
 
-        vector<Document> matched_documents;
-        for (const auto [document_id, relevance] : document_to_relevance) {
-            matched_documents.push_back(
-                {document_id, relevance, documents_.at(document_id).rating});
+template <typename DocumentPredicate>
+    std::vector<Document> SearchServer::FindAllDocuments(const SearchServer::SegmentList& segments, const SearchServer::Query& query,
+     DocumentPredicate document_predicate, const CorpusStatistics* statistics) const {
+        const auto words = SearchServer::ComputeTermWeights(segments, query, statistics);
+        std::vector<Document> matched_documents;
+        for (const auto& segment : segments.segments) {
+            const uint32_t size = static_cast<uint32_t>(segment->size());
+            auto accumulator = accumulator_pool_.Acquire(size);
+            SearchServer::ExcludeMinusWords(*accumulator, *segment, 0, size, query);
+            for (const WeightedTerm& word : words) {
+                SearchServer::AccumulateRelevance(*accumulator, *segment, 0, size, word, document_predicate);
+            }
+            SearchServer::CollectDocuments(*accumulator, *segment, matched_documents);
         }
         return matched_documents;
     }
 
 template <typename DocumentPredicate>
-    std::vector<Document> SearchServer::FindAllDocuments(const std::execution::parallel_policy&, const SearchServer::Query& query,
-     DocumentPredicate document_predicate) const {
+    std::vector<Document> SearchServer::FindTopDocumentsByRanges(const PoolExecutionPolicy& policy, const SearchServer::SegmentList& segments,
+     const SearchServer::Query& query, DocumentPredicate document_predicate, const SearchOptions& options) const {
     using namespace std;
-   
-        ConcurrentMap<int, double> document_to_relevance(100);
-    for_each(execution::par,query.plus_words.begin(),query.plus_words.end(),[this,&document_predicate, &document_to_relevance](const string& word){if (word_to_document_freqs_.count(word) == 0) {
-                return;
+        if (options.top_k == 0) {
+            return {};
+        }
+        const auto words = SearchServer::ComputeTermWeights(segments, query, options.corpus_statistics);
+        const auto pool = SearchServer::GetThreadPool();
+        size_t total_size = 0;
+        for (const auto& segment : segments.segments) {
+            total_size += segment->size();
+        }
+        // по несколько диапазонов на поток, чтобы задачи выравнивались по времени;
+        // диапазон не переходит границу сегмента
+        const size_t range_size = policy.grain > 0
+            ? policy.grain
+            : max(MIN_RANGE_SIZE, (total_size + RANGES_PER_THREAD * (pool->GetThreadCount() + 1) - 1) / (RANGES_PER_THREAD * (pool->GetThreadCount() + 1)));
+        struct Range {
+            const IndexSegment* segment;
+            uint32_t first;
+            uint32_t last;
+        };
+        vector<Range> ranges;
+        for (const auto& segment : segments.segments) {
+            for (size_t first = 0; first < segment->size(); first += range_size) {
+                ranges.push_back({segment.get(), static_cast<uint32_t>(first), static_cast<uint32_t>(min(segment->size(), first + range_size))});
             }
-            const double inverse_document_freq = SearchServer::ComputeWordInverseDocumentFreq(word);
-            for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-                const auto& document_data = documents_.at(document_id);
-                if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                    document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
-                }
-            }});
+        }
+        vector<TopDocuments> partial(ranges.size(), TopDocuments(GetTopCapacity(options.top_k, options.offset)));
+        pool->ParallelFor(ranges.size(), 1, [this, &ranges, &words, &query, &partial, &document_predicate](size_t index) {
+            const Range& range = ranges[index];
+            auto accumulator = accumulator_pool_.Acquire(range.last - range.first);
+            SearchServer::ExcludeMinusWords(*accumulator, *range.segment, range.first, range.last, query);
+            for (const WeightedTerm& word : words) {
+                SearchServer::AccumulateRelevance(*accumulator, *range.segment, range.first, range.last, word, document_predicate);
+            }
+            accumulator->ForEachScored([&range, &top = partial[index]](uint32_t offset, double relevance) {
+                const uint32_t ordinal = range.first + offset;
+                top.Push({range.segment->GetId(ordinal), relevance, range.segment->GetRating(ordinal)});
+            });
+        });
+        if (partial.empty()) {
+            return {};
+        }
+        for (size_t i = 1; i < partial.size(); ++i) {
+            partial[0].Merge(partial[i]);
+        }
+        return partial[0].Extract(options.offset);
+    }
 
-    for_each(execution::par,query.minus_words.begin(),query.minus_words.end(),[this, &document_to_relevance](const string& word){ if (word_to_document_freqs_.count(word) == 0) {
-                return;
+template <typename DocumentPredicate>
+    std::vector<Document> SearchServer::FindTopDocumentsWithPruning(const SearchServer::SegmentList& segments, const SearchServer::Query& query,
+     DocumentPredicate document_predicate, const SearchOptions& options) const {
+    using namespace std;
+        if (options.top_k == 0) {
+            return {};
+        }
+        const auto words = SearchServer::ComputeTermWeights(segments, query, options.corpus_statistics);
+        TopDocuments top(GetTopCapacity(options.top_k, options.offset));
+        SearchServer::CollectTopDocumentsWithPruning(segments, words, query, document_predicate, top);
+        return top.Extract(options.offset);
+    }
+
+template <typename DocumentPredicate>
+    void SearchServer::CollectTopDocumentsWithPruning(const SearchServer::SegmentList& segments, const std::vector<WeightedTerm>& words,
+     const SearchServer::Query& query, DocumentPredicate& document_predicate, TopDocuments& top) {
+    using namespace std;
+        // общая куча переносит порог отсечения из сегмента в сегмент
+        for (const auto& segment : segments.segments) {
+            if constexpr (IS_STATUS_PREDICATE<DocumentPredicate>) {
+                if (segment->CountStatus(document_predicate.status) == 0) {
+                    continue;
+                }
+            }
+            vector<WandTerm> plus_terms;
+            for (const WeightedTerm& word : words) {
+                if (const PostingList* postings = segment->FindPostings(word.term_id)) {
+                    plus_terms.push_back({postings, word.inverse_document_freq});
+                }
             }
-            for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-                document_to_relevance.erase(document_id);
-            }});
-
-        vector<Document> matched_documents;
-        for (const auto [document_id, relevance] : document_to_relevance.BuildOrdinaryMap()) {
-            matched_documents.push_back(
-                {document_id, relevance, documents_.at(document_id).rating});
+            vector<const PostingList*> minus_terms;
+            for (const TermId word : query.minus_words) {
+                if (const PostingList* postings = segment->FindPostings(word)) {
+                    minus_terms.push_back(postings);
+                }
+            }
+            const IndexSegment& current = *segment;
+            RunBlockMaxWand(plus_terms, minus_terms,
+                [&current](uint32_t ordinal, uint32_t count) {
+                    return current.ComputeTermFreq(ordinal, count);
+                },
+                [&current, &document_predicate](uint32_t ordinal, double relevance, Document& document) {
+                    if (current.IsRemoved(ordinal)) {
+                        return false;
+                    }
+                    if (!document_predicate(current.GetId(ordinal), current.GetStatus(ordinal), current.GetRating(ordinal))) {
+                        return false;
+                    }
+                    document = {current.GetId(ordinal), relevance, current.GetRating(ordinal)};
+                    return true;
+                }, top);
         }
-        return matched_documents;
     }
 
+template <typename DocumentPredicate>
+    void SearchServer::FindTopDocuments(const SearchServer::PreparedQuery& query, DocumentPredicate document_predicate, const SearchOptions& options,
+     std::vector<Document>& result) const {
+        const uint64_t epoch = index_epoch_.load(std::memory_order_acquire);
+        const auto segments = SearchServer::AcquireSegments();
+        if (query.epoch_ == epoch) {
+            SearchServer::FindPreparedDocuments(*segments, query, document_predicate, options, result);
+        } else {
+            // индекс изменился после подготовки: IDF и слова собираются заново
+            SearchServer::FindPreparedDocuments(*segments, SearchServer::PrepareQuery(*segments, query.raw_query_, epoch),
+                document_predicate, options, result);
+        }
+    }
+
+template <typename DocumentPredicate>
+    void SearchServer::FindPreparedDocuments(const SearchServer::SegmentList& segments, const SearchServer::PreparedQuery& query,
+     DocumentPredicate& document_predicate, const SearchOptions& options, std::vector<Document>& result) const {
+        // куча строится в памяти result, документы кладутся в неё прямо из аккумулятора
+        TopDocuments top(GetTopCapacity(options.top_k, options.offset), std::move(result));
+        if (options.dynamic_pruning && options.top_k > 0) {
+            SearchServer::CollectTopDocumentsWithPruning(segments, query.words_, query.query_, document_predicate, top);
+        } else if (options.top_k > 0) {
+            for (const auto& segment : segments.segments) {
+                const uint32_t size = static_cast<uint32_t>(segment->size());
+                auto accumulator = accumulator_pool_.Acquire(size);
+                SearchServer::ExcludeMinusWords(*accumulator, *segment, 0, size, query.query_);
+                for (const WeightedTerm& word : query.words_) {
+                    SearchServer::AccumulateRelevance(*accumulator, *segment, 0, size, word, document_predicate);
+                }
+                accumulator->ForEachScored([&segment, &top](uint32_t ordinal, double relevance) {
+                    top.Push({segment->GetId(ordinal), relevance, segment->GetRating(ordinal)});
+                });
+            }
+        }
+        top.ExtractTo(options.offset, result);
+    }
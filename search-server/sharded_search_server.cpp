@@ -0,0 +1,142 @@
+#include "sharded_search_server.h"
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+using namespace std;
+
+namespace {
+
+// Статистика одного запроса: собрана до рассылки, части её только читают
+class QueryStatistics : public CorpusStatistics {
+public:
+    QueryStatistics(size_t document_count, map<string, size_t, less<>> document_freqs)
+        : document_count_(document_count)
+        , document_freqs_(move(document_freqs)) {
+    }
+
+    size_t GetDocumentCount() const override {
+        return document_count_;
+    }
+
+    size_t GetDocumentFrequency(string_view word) const override {
+        const auto it = document_freqs_.find(word);
+        return it == document_freqs_.end() ? 0 : it->second;
+    }
+
+private:
+    size_t document_count_;
+    map<string, size_t, less<>> document_freqs_;
+};
+
+} // namespace
+
+// Статистика по всем частям: частям нужен IDF всего корпуса, а не своей доли.
+// Запросы ShardedSearchServer передают частям свою QueryStatistics, эта нужна запросам
+// к частям напрямую через GetShard и считается при каждом обращении.
+class ShardedSearchServer::Statistics : public CorpusStatistics {
+public:
+    explicit Statistics(const ShardedSearchServer& server)
+        : server_(server) {
+    }
+
+    size_t GetDocumentCount() const override {
+        return static_cast<size_t>(server_.GetDocumentCount());
+    }
+
+    size_t GetDocumentFrequency(string_view word) const override {
+        size_t document_freq = 0;
+        for (const auto& shard : server_.shards_) {
+            document_freq += shard->GetDocumentFrequency(word);
+        }
+        return document_freq;
+    }
+
+private:
+    const ShardedSearchServer& server_;
+};
+
+ShardedSearchServer::ShardedSearchServer(const string& stop_words_text, size_t shard_count)
+    : ShardedSearchServer(SplitIntoWords(stop_words_text), shard_count) {
+}
+
+ShardedSearchServer::ShardedSearchServer(string_view stop_words_text, size_t shard_count)
+    : ShardedSearchServer(SplitIntoWords(stop_words_text), shard_count) {
+}
+
+size_t ShardedSearchServer::CheckShardCount(size_t shard_count) {
+    if (shard_count == 0) {
+        throw invalid_argument("Shard count must be positive"s);
+    }
+    return shard_count;
+}
+
+void ShardedSearchServer::InitStatistics() {
+    const auto statistics = make_shared<const Statistics>(*this);
+    for (const auto& shard : shards_) {
+        shard->SetCorpusStatistics(statistics);
+    }
+}
+
+unique_ptr<const CorpusStatistics> ShardedSearchServer::CollectQueryStatistics(string_view raw_query) const {
+    // частоты нужны только плюс-словам; неверные слова отвергнет разбор запроса в частях
+    map<string, size_t, less<>> document_freqs;
+    for (const string_view word : SplitIntoWords(raw_query)) {
+        if (!word.empty() && word[0] != '-') {
+            document_freqs.emplace(word, 0);
+        }
+    }
+    for (auto& [word, document_freq] : document_freqs) {
+        for (const auto& shard : shards_) {
+            document_freq += shard->GetDocumentFrequency(word);
+        }
+    }
+    return make_unique<const QueryStatistics>(static_cast<size_t>(ShardedSearchServer::GetDocumentCount()), move(document_freqs));
+}
+
+size_t ShardedSearchServer::GetShardIndex(int document_id) const {
+    // перемешивание битов: id, идущие с шагом, не должны собираться в одной части
+    uint64_t hash = static_cast<uint32_t>(document_id) * 0x9E3779B97F4A7C15ull;
+    hash ^= hash >> 32;
+    return hash % shards_.size();
+}
+
+void ShardedSearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    if (document_id < 0) {
+        throw invalid_argument("Invalid document_id"s);
+    }
+    shards_[ShardedSearchServer::GetShardIndex(document_id)]->AddDocument(document_id, document, status, ratings);
+}
+
+void ShardedSearchServer::RemoveDocument(int document_id) {
+    if (document_id < 0) {
+        return;
+    }
+    shards_[ShardedSearchServer::GetShardIndex(document_id)]->RemoveDocument(document_id);
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status) const {
+    return ShardedSearchServer::FindTopDocuments(raw_query, StatusPredicate{status}, SearchOptions());
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status, const SearchOptions& options) const {
+    return ShardedSearchServer::FindTopDocuments(raw_query, StatusPredicate{status}, options);
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(string_view raw_query) const {
+    return ShardedSearchServer::FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+
+SearchServer::matchtuple ShardedSearchServer::MatchDocument(string_view raw_query, int document_id) const {
+    if (document_id < 0) {
+        throw out_of_range("Out of range"s);
+    }
+    return shards_[ShardedSearchServer::GetShardIndex(document_id)]->MatchDocument(raw_query, document_id);
+}
+
+int ShardedSearchServer::GetDocumentCount() const {
+    int document_count = 0;
+    for (const auto& shard : shards_) {
+        document_count += shard->GetDocumentCount();
+    }
+    return document_count;
+}
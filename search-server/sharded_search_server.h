@@ -0,0 +1,95 @@
+#pragma once
+#include "search_server.h"
+#include "thread_pool.h"
+#include "top_documents.h"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Корпус, разбитый по хешу id на несколько SearchServer. У каждой части свои сегменты
+// и своя блокировка записи, поэтому добавления в разные части идут параллельно.
+// IDF считается по всем частям, и выдача та же, что у одного сервера со всеми документами:
+// число документов и частоты плюс-слов собираются по частям один раз на запрос.
+// Запрос рассылается всем частям параллельно, их top сливаются; AddDocument, RemoveDocument
+// и MatchDocument идут только в часть, которой принадлежит документ.
+class ShardedSearchServer {
+public:
+    template <typename StringContainer>
+    ShardedSearchServer(const StringContainer& stop_words, size_t shard_count);
+    ShardedSearchServer(const std::string& stop_words_text, size_t shard_count);
+    ShardedSearchServer(std::string_view stop_words_text, size_t shard_count);
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+
+    void RemoveDocument(int document_id);
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate,
+                                           const SearchOptions& options = SearchOptions()) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status, const SearchOptions& options) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
+
+    SearchServer::matchtuple MatchDocument(std::string_view raw_query, int document_id) const;
+
+    int GetDocumentCount() const;
+
+    size_t GetShardCount() const {
+        return shards_.size();
+    }
+
+    // номер части, которой принадлежит документ
+    size_t GetShardIndex(int document_id) const;
+
+    const SearchServer& GetShard(size_t index) const {
+        return *shards_[index];
+    }
+
+private:
+    class Statistics;
+
+    // бросает invalid_argument, если частей нет
+    static size_t CheckShardCount(size_t shard_count);
+
+    void InitStatistics();
+
+    // статистика для IDF запроса raw_query по всем частям
+    std::unique_ptr<const CorpusStatistics> CollectQueryStatistics(std::string_view raw_query) const;
+
+    std::vector<std::unique_ptr<SearchServer>> shards_;
+    mutable ThreadPool pool_;
+};
+
+template <typename StringContainer>
+ShardedSearchServer::ShardedSearchServer(const StringContainer& stop_words, size_t shard_count)
+    : pool_(ShardedSearchServer::CheckShardCount(shard_count)) {
+    using namespace std;
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards_.push_back(make_unique<SearchServer>(stop_words));
+    }
+    ShardedSearchServer::InitStatistics();
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate,
+                                                            const SearchOptions& options) const {
+    // каждая часть отдаёт свои первые top_k + offset, позиции [offset, offset + top_k)
+    // общей выдачи среди них точно есть
+    const auto statistics = ShardedSearchServer::CollectQueryStatistics(raw_query);
+    SearchOptions shard_options = options;
+    shard_options.top_k = GetTopCapacity(options.top_k, options.offset);
+    shard_options.offset = 0;
+    shard_options.corpus_statistics = statistics.get();
+    std::vector<std::vector<Document>> partial(shards_.size());
+    pool_.ParallelFor(shards_.size(), 1, [this, raw_query, &document_predicate, &shard_options, &partial](size_t i) {
+        partial[i] = shards_[i]->FindTopDocuments(std::execution::seq, raw_query, document_predicate, shard_options);
+    });
+    TopDocuments top(GetTopCapacity(options.top_k, options.offset));
+    for (const auto& documents : partial) {
+        for (const Document& document : documents) {
+            top.Push(document);
+        }
+    }
+    return top.Extract(options.offset);
+}
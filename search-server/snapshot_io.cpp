@@ -0,0 +1,184 @@
+#include "snapshot_io.h"
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+
+namespace {
+
+const char SNAPSHOT_MAGIC[8] = {'S', 'R', 'C', 'H', 'S', 'N', 'A', 'P'};
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+const size_t SNAPSHOT_ALIGNMENT = 8;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t payload_size;
+    uint64_t checksum;
+};
+
+} // namespace
+
+MappedFile::MappedFile(const string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("Cannot open "s + path);
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        throw runtime_error("Cannot map "s + path);
+    }
+    void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw runtime_error("Cannot map "s + path);
+    }
+    data_ = static_cast<const char*>(data);
+    size_ = info.st_size;
+}
+
+MappedFile::~MappedFile() {
+    munmap(const_cast<char*>(data_), size_);
+}
+
+void SnapshotChecksum::Update(const void* data, size_t size) {
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    total_size_ += size;
+    while (size > 0 && tail_size_ > 0) {
+        tail_ |= static_cast<uint64_t>(*bytes++) << (8 * tail_size_);
+        --size;
+        if (++tail_size_ == 8) {
+            Mix(tail_);
+            tail_ = 0;
+            tail_size_ = 0;
+        }
+    }
+    for (; size >= 8; size -= 8, bytes += 8) {
+        uint64_t word;
+        memcpy(&word, bytes, 8);
+        Mix(word);
+    }
+    for (; size > 0; --size) {
+        tail_ |= static_cast<uint64_t>(*bytes++) << (8 * tail_size_++);
+    }
+}
+
+uint64_t SnapshotChecksum::Finish() const {
+    SnapshotChecksum copy = *this;
+    copy.Mix(tail_ ^ total_size_);
+    return copy.state_;
+}
+
+void SnapshotChecksum::Mix(uint64_t word) {
+    state_ = (state_ ^ word) * 0x100000001B3ull;
+    state_ ^= state_ >> 29;
+}
+
+SnapshotWriter::SnapshotWriter(const string& path)
+    : path_(path)
+    , temp_path_(path + ".tmp"s)
+    , out_(temp_path_, ios::binary | ios::trunc) {
+    if (!out_) {
+        throw runtime_error("Cannot create "s + temp_path_);
+    }
+    const SnapshotHeader placeholder{};
+    out_.write(reinterpret_cast<const char*>(&placeholder), sizeof(placeholder));
+}
+
+SnapshotWriter::~SnapshotWriter() {
+    if (!finished_) {
+        out_.close();
+        unlink(temp_path_.c_str());
+    }
+}
+
+void SnapshotWriter::Finish() {
+    SnapshotHeader header{};
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order = BYTE_ORDER_MARK;
+    header.payload_size = payload_size_;
+    header.checksum = checksum_.Finish();
+    out_.seekp(0);
+    out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out_.close();
+    if (!out_) {
+        throw runtime_error("Cannot write "s + temp_path_);
+    }
+    // данные должны быть на диске раньше, чем имя начнёт указывать на них
+    const int fd = open(temp_path_.c_str(), O_RDONLY);
+    if (fd < 0 || fsync(fd) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        throw runtime_error("Cannot sync "s + temp_path_);
+    }
+    close(fd);
+    if (rename(temp_path_.c_str(), path_.c_str()) != 0) {
+        throw runtime_error("Cannot rename "s + temp_path_ + " to "s + path_);
+    }
+    finished_ = true;
+    // запись о переименовании сохраняется вместе с каталогом
+    const size_t slash = path_.rfind('/');
+    const string directory = slash == string::npos ? "."s : (slash == 0 ? "/"s : path_.substr(0, slash));
+    const int directory_fd = open(directory.c_str(), O_RDONLY);
+    if (directory_fd >= 0) {
+        fsync(directory_fd);
+        close(directory_fd);
+    }
+}
+
+void SnapshotWriter::WriteBytes(const void* data, size_t size) {
+    out_.write(static_cast<const char*>(data), size);
+    checksum_.Update(data, size);
+    payload_size_ += size;
+}
+
+void SnapshotWriter::Pad() {
+    static const char zeros[SNAPSHOT_ALIGNMENT] = {};
+    WriteBytes(zeros, (SNAPSHOT_ALIGNMENT - payload_size_ % SNAPSHOT_ALIGNMENT) % SNAPSHOT_ALIGNMENT);
+}
+
+SnapshotReader::SnapshotReader(const MappedFile& file) {
+    SnapshotHeader header;
+    if (file.size() < sizeof(header)) {
+        ThrowCorrupted();
+    }
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 || header.byte_order != BYTE_ORDER_MARK) {
+        throw runtime_error("Not a search server snapshot"s);
+    }
+    if (header.version != SNAPSHOT_VERSION) {
+        throw runtime_error("Unsupported snapshot version "s + to_string(header.version));
+    }
+    if (header.payload_size != file.size() - sizeof(header)) {
+        ThrowCorrupted();
+    }
+    position_ = file.data() + sizeof(header);
+    end_ = position_ + header.payload_size;
+    SnapshotChecksum checksum;
+    checksum.Update(position_, header.payload_size);
+    if (checksum.Finish() != header.checksum) {
+        ThrowCorrupted();
+    }
+}
+
+const char* SnapshotReader::Take(size_t size) {
+    const size_t padded = (size + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+    if (padded > static_cast<size_t>(end_ - position_)) {
+        ThrowCorrupted();
+    }
+    const char* result = position_;
+    position_ += padded;
+    return result;
+}
+
+void SnapshotReader::ThrowCorrupted() const {
+    throw runtime_error("Snapshot is corrupted"s);
+}
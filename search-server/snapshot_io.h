@@ -0,0 +1,136 @@
+#pragma once
+#include "cow_array.h"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+const uint32_t SNAPSHOT_VERSION = 3;
+
+// Файл, отображённый в память только для чтения.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    const char* data() const {
+        return data_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+class SnapshotChecksum {
+public:
+    void Update(const void* data, size_t size);
+    uint64_t Finish() const;
+
+private:
+    void Mix(uint64_t word);
+
+    uint64_t state_ = 0x9E3779B97F4A7C15ull;
+    uint64_t tail_ = 0;
+    size_t tail_size_ = 0;
+    uint64_t total_size_ = 0;
+};
+
+// Пишет снимок: заголовок с версией и контрольной суммой, затем значения и массивы,
+// каждый с выравниванием на 8 байт, чтобы их можно было читать прямо из отображения.
+// Данные идут во временный файл path + ".tmp", и Finish заменяет им path только целиком
+// записанный снимок. Поэтому прежний файл не портится при ошибке и его можно читать
+// во время записи, в том числе когда сохраняемый сервер открыт из этого же файла.
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(const std::string& path);
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+    // без Finish временный файл удаляется
+    ~SnapshotWriter();
+
+    template <typename T>
+    void WriteValue(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        WriteBytes(&value, sizeof(T));
+        Pad();
+    }
+
+    template <typename T>
+    void WriteArray(const T* data, size_t count) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        WriteValue<uint64_t>(count);
+        WriteBytes(data, count * sizeof(T));
+        Pad();
+    }
+
+    template <typename Container>
+    void WriteArray(const Container& container) {
+        WriteArray(container.data(), container.size());
+    }
+
+    void WriteString(std::string_view text) {
+        WriteArray(text.data(), text.size());
+    }
+
+    // дописывает заголовок, сбрасывает файл на диск и переименовывает его в path
+    void Finish();
+
+private:
+    void WriteBytes(const void* data, size_t size);
+    void Pad();
+
+    std::string path_;
+    std::string temp_path_;
+    std::ofstream out_;
+    bool finished_ = false;
+    uint64_t payload_size_ = 0;
+    SnapshotChecksum checksum_;
+};
+
+// Читает снимок из отображённого файла. Массивы не копируются: возвращается
+// CowArray, ссылающийся на память файла.
+class SnapshotReader {
+public:
+    // проверяет заголовок и контрольную сумму
+    explicit SnapshotReader(const MappedFile& file);
+
+    template <typename T>
+    T ReadValue() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        T value;
+        std::memcpy(&value, Take(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    CowArray<T> ReadArray() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        const uint64_t count = ReadValue<uint64_t>();
+        if (count > (end_ - position_) / sizeof(T)) {
+            ThrowCorrupted();
+        }
+        return CowArray<T>::View(reinterpret_cast<const T*>(Take(count * sizeof(T))), count);
+    }
+
+    std::string_view ReadString() {
+        const auto chars = ReadArray<char>();
+        return {chars.data(), chars.size()};
+    }
+
+private:
+    const char* Take(size_t size);
+    [[noreturn]] void ThrowCorrupted() const;
+
+    const char* position_;
+    const char* end_;
+};
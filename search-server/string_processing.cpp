@@ -1,22 +1,140 @@
 #include "string_processing.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 using namespace std;
 
-vector<string> SplitIntoWords(string_view text){
-       vector<string> words;
-    string word;
-    for (const char c : text) {
-        if (c == ' ') {
-            if (!word.empty()) {
-                words.push_back(word);
-                word.clear();
-            }
+namespace {
+
+// Текст просматривается блоками по 64 байта: для блока строятся битовые маски
+// пробелов и управляющих символов, а границы слов берутся из установленных битов.
+const size_t SCAN_BLOCK_SIZE = 64;
+
+struct BlockMasks {
+    uint64_t spaces;
+    uint64_t controls;
+};
+
+int CountTrailingZeros(uint64_t mask) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(mask);
+#else
+    int count = 0;
+    for (; (mask & 1) == 0; mask >>= 1) {
+        ++count;
+    }
+    return count;
+#endif
+}
+
+[[maybe_unused]] BlockMasks ScanBlockScalar(const char* data) {
+    BlockMasks masks{0, 0};
+    for (size_t i = 0; i < SCAN_BLOCK_SIZE; ++i) {
+        const auto c = static_cast<unsigned char>(data[i]);
+        masks.spaces |= static_cast<uint64_t>(c == ' ') << i;
+        masks.controls |= static_cast<uint64_t>(c < ' ') << i;
+    }
+    return masks;
+}
+
+#if defined(__SSE2__)
+BlockMasks ScanBlockSse2(const char* data) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i last_control = _mm_set1_epi8(' ' - 1);
+    BlockMasks masks{0, 0};
+    for (size_t i = 0; i < SCAN_BLOCK_SIZE; i += 16) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        const __m128i spaces = _mm_cmpeq_epi8(bytes, space);
+        // беззнаковое c <= 0x1F: min(c, 0x1F) == c
+        const __m128i controls = _mm_cmpeq_epi8(_mm_min_epu8(bytes, last_control), bytes);
+        masks.spaces |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(spaces))) << i;
+        masks.controls |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(controls))) << i;
+    }
+    return masks;
+}
+#endif
+
+#if defined(__GNUC__) && defined(__x86_64__)
+__attribute__((target("avx2"))) BlockMasks ScanBlockAvx2(const char* data) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i last_control = _mm256_set1_epi8(' ' - 1);
+    BlockMasks masks{0, 0};
+    for (size_t i = 0; i < SCAN_BLOCK_SIZE; i += 32) {
+        const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        const __m256i spaces = _mm256_cmpeq_epi8(bytes, space);
+        const __m256i controls = _mm256_cmpeq_epi8(_mm256_min_epu8(bytes, last_control), bytes);
+        masks.spaces |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(spaces))) << i;
+        masks.controls |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(controls))) << i;
+    }
+    return masks;
+}
+#endif
+
+using ScanBlock = BlockMasks (*)(const char*);
+
+// набор инструкций выбирается один раз, по процессору, на котором идёт работа
+ScanBlock ChooseScanBlock() {
+#if defined(__GNUC__) && defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2")) {
+        return ScanBlockAvx2;
+    }
+#endif
+#if defined(__SSE2__)
+    return ScanBlockSse2;
+#else
+    return ScanBlockScalar;
+#endif
+}
+
+} // namespace
+
+size_t SplitIntoWords(string_view text, vector<string_view>& words) {
+    static const ScanBlock scan_block = ChooseScanBlock();
+    words.clear();
+    size_t first_control = text.size();
+    size_t word_begin = 0;
+    for (size_t block = 0; block < text.size(); block += SCAN_BLOCK_SIZE) {
+        const size_t block_size = min(SCAN_BLOCK_SIZE, text.size() - block);
+        BlockMasks masks;
+        if (block_size == SCAN_BLOCK_SIZE) {
+            masks = scan_block(text.data() + block);
         } else {
-            word += c;
+            // хвост дополняется пробелами, их биты затем отбрасываются
+            char tail[SCAN_BLOCK_SIZE];
+            memset(tail, ' ', SCAN_BLOCK_SIZE);
+            memcpy(tail, text.data() + block, block_size);
+            masks = scan_block(tail);
+            masks.spaces &= (uint64_t{1} << block_size) - 1;
+        }
+        if (masks.controls != 0 && first_control == text.size()) {
+            first_control = block + CountTrailingZeros(masks.controls);
         }
+        for (uint64_t spaces = masks.spaces; spaces != 0; spaces &= spaces - 1) {
+            const size_t position = block + CountTrailingZeros(spaces);
+            if (position > word_begin) {
+                words.emplace_back(text.data() + word_begin, position - word_begin);
+            }
+            word_begin = position + 1;
+        }
+    }
+    if (word_begin < text.size()) {
+        words.emplace_back(text.data() + word_begin, text.size() - word_begin);
     }
-    if (!word.empty()) {
-        words.push_back(word);
+    if (first_control == text.size()) {
+        return words.size();
     }
+    // управляющий символ не пробел, поэтому лежит внутри слова: последнего, начавшегося не позже него
+    const char* control = text.data() + first_control;
+    return upper_bound(words.begin(), words.end(), control, [](const char* position, string_view word) {
+        return position < word.data();
+    }) - words.begin() - 1;
+}
 
+vector<string_view> SplitIntoWords(string_view text) {
+    vector<string_view> words;
+    SplitIntoWords(text, words);
     return words;
-}
\ No newline at end of file
+}
@@ -1,21 +1,28 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <set>
 #include <vector>
 
-std::vector<std::string> SplitIntoWords(std::string_view text);
+// Слова текста (разделитель - пробел) как string_view в text, без копирования.
+std::vector<std::string_view> SplitIntoWords(std::string_view text);
+
+// То же в буфер вызывающего: words очищается, но его память переиспользуется.
+// Заодно ищет управляющие символы (0x00-0x1F) и возвращает номер первого слова
+// с таким символом или words.size(), если таких слов нет.
+size_t SplitIntoWords(std::string_view text, std::vector<std::string_view>& words);
 
 template <typename StringContainer>
-std::set<std::string> MakeUniqueNonEmptyStrings(const StringContainer& strings);
+std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings);
 
 template <typename StringContainer>
-std::set<std::string> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
-    std::set<std::string> non_empty_strings;
-    for (const std::string& str : strings) {
-        if (!str.empty()) {
-            non_empty_strings.insert(str);
+std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
+    std::set<std::string, std::less<>> non_empty_strings;
+    for (const auto& str : strings) {
+        if (!std::string_view(str).empty()) {
+            non_empty_strings.emplace(str);
         }
     }
     return non_empty_strings;
-}
\ No newline at end of file
+}
@@ -0,0 +1,101 @@
+#include "term_dictionary.h"
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+using namespace std;
+
+TermDictionary::TermDictionary(TermDictionary&& other)
+    : arena_blocks_(move(other.arena_blocks_))
+    , arena_current_(other.arena_current_)
+    , arena_block_used_(other.arena_block_used_)
+    , terms_(move(other.terms_))
+    , term_to_id_(move(other.term_to_id_)) {
+}
+
+TermId TermDictionary::Intern(string_view term) {
+    {
+        shared_lock guard(mutex_);
+        const auto it = term_to_id_.find(term);
+        if (it != term_to_id_.end()) {
+            return it->second;
+        }
+    }
+    unique_lock guard(mutex_);
+    const auto it = term_to_id_.find(term);
+    if (it != term_to_id_.end()) {
+        return it->second;
+    }
+    const TermId term_id = static_cast<TermId>(terms_.size());
+    const string_view stored = StoreBytes(term);
+    terms_.push_back(stored);
+    term_to_id_.emplace(stored, term_id);
+    return term_id;
+}
+
+TermId TermDictionary::Find(string_view term) const {
+    shared_lock guard(mutex_);
+    const auto it = term_to_id_.find(term);
+    return it == term_to_id_.end() ? INVALID_TERM_ID : it->second;
+}
+
+string_view TermDictionary::GetTerm(TermId term_id) const {
+    shared_lock guard(mutex_);
+    return terms_.at(term_id);
+}
+
+size_t TermDictionary::size() const {
+    shared_lock guard(mutex_);
+    return terms_.size();
+}
+
+void TermDictionary::WriteTo(SnapshotWriter& writer) const {
+    shared_lock guard(mutex_);
+    vector<uint64_t> offsets;
+    offsets.reserve(terms_.size() + 1);
+    string bytes;
+    for (const string_view term : terms_) {
+        offsets.push_back(bytes.size());
+        bytes += term;
+    }
+    offsets.push_back(bytes.size());
+    writer.WriteArray(offsets);
+    writer.WriteString(bytes);
+}
+
+TermDictionary TermDictionary::ReadFrom(SnapshotReader& reader) {
+    const auto offsets = reader.ReadArray<uint64_t>();
+    const string_view bytes = reader.ReadString();
+    if (offsets.empty() || offsets.back() != bytes.size()) {
+        throw runtime_error("Snapshot is corrupted"s);
+    }
+    TermDictionary result;
+    result.terms_.reserve(offsets.size() - 1);
+    result.term_to_id_.reserve(offsets.size() - 1);
+    for (size_t i = 0; i + 1 < offsets.size(); ++i) {
+        const string_view term = bytes.substr(offsets[i], offsets[i + 1] - offsets[i]);
+        result.term_to_id_.emplace(term, static_cast<TermId>(result.terms_.size()));
+        result.terms_.push_back(term);
+    }
+    return result;
+}
+
+string_view TermDictionary::StoreBytes(string_view term) {
+    if (term.empty()) {
+        return {};
+    }
+    // слишком длинное слово получает собственный блок, чтобы не бросать остаток текущего
+    if (term.size() > ARENA_BLOCK_SIZE / 4) {
+        char* dest = arena_blocks_.emplace_back(new char[term.size()]).get();
+        memcpy(dest, term.data(), term.size());
+        return {dest, term.size()};
+    }
+    if (ARENA_BLOCK_SIZE - arena_block_used_ < term.size()) {
+        arena_current_ = arena_blocks_.emplace_back(new char[ARENA_BLOCK_SIZE]).get();
+        arena_block_used_ = 0;
+    }
+    char* dest = arena_current_ + arena_block_used_;
+    memcpy(dest, term.data(), term.size());
+    arena_block_used_ += term.size();
+    return {dest, term.size()};
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "snapshot_io.h"
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using TermId = uint32_t;
+const TermId INVALID_TERM_ID = static_cast<TermId>(-1);
+
+// Интернирует различные слова корпуса: каждому слову выдаётся плотный TermId,
+// а байты слова один раз копируются в арену. string_view, выданные словарём,
+// остаются валидными всё время жизни словаря (в том числе после перемещения).
+// Intern можно вызывать одновременно с Find и GetTerm из других потоков.
+class TermDictionary {
+public:
+    TermDictionary() = default;
+    TermDictionary(TermDictionary&& other);
+
+    TermId Intern(std::string_view term);
+
+    // INVALID_TERM_ID, если слово ни разу не встречалось
+    TermId Find(std::string_view term) const;
+
+    std::string_view GetTerm(TermId term_id) const;
+
+    size_t size() const;
+
+    void WriteTo(SnapshotWriter& writer) const;
+    // слова из снимка не копируются в арену: string_view указывают в память снимка
+    static TermDictionary ReadFrom(SnapshotReader& reader);
+
+private:
+    static const size_t ARENA_BLOCK_SIZE = 64 * 1024;
+
+    std::string_view StoreBytes(std::string_view term);
+
+    std::vector<std::unique_ptr<char[]>> arena_blocks_;
+    char* arena_current_ = nullptr;
+    size_t arena_block_used_ = ARENA_BLOCK_SIZE;
+    std::vector<std::string_view> terms_;
+    std::unordered_map<std::string_view, TermId> term_to_id_;
+    mutable std::shared_mutex mutex_;
+};
@@ -0,0 +1,1199 @@
+#include "test_example_functions.h"
+#include "log_duration.h"
+#include "near_duplicates.h"
+#include "process_queries.h"
+#include "remove_duplicates.h"
+#include "request_queue.h"
+#include "search_server.h"
+#include "sharded_search_server.h"
+#include "test_framework.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <execution>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+namespace {
+
+string GenerateWord(mt19937& generator, int max_length) {
+    const int length = uniform_int_distribution(1, max_length)(generator);
+    string word;
+    word.reserve(length);
+    for (int i = 0; i < length; ++i) {
+        word.push_back(uniform_int_distribution('a', 'z')(generator));
+    }
+    return word;
+}
+
+vector<string> GenerateDictionary(mt19937& generator, int word_count, int max_length) {
+    vector<string> words;
+    words.reserve(word_count);
+    for (int i = 0; i < word_count; ++i) {
+        words.push_back(GenerateWord(generator, max_length));
+    }
+    sort(words.begin(), words.end());
+    words.erase(unique(words.begin(), words.end()), words.end());
+    return words;
+}
+
+string GenerateQuery(mt19937& generator, const vector<string>& dictionary, int word_count, double minus_prob = 0) {
+    string query;
+    for (int i = 0; i < word_count; ++i) {
+        if (!query.empty()) {
+            query.push_back(' ');
+        }
+        if (uniform_real_distribution<>(0, 1)(generator) < minus_prob) {
+            query.push_back('-');
+        }
+        query += dictionary[uniform_int_distribution<int>(0, dictionary.size() - 1)(generator)];
+    }
+    return query;
+}
+
+vector<string> GenerateQueries(mt19937& generator, const vector<string>& dictionary, int query_count, int max_word_count) {
+    vector<string> queries;
+    queries.reserve(query_count);
+    for (int i = 0; i < query_count; ++i) {
+        queries.push_back(GenerateQuery(generator, dictionary, max_word_count));
+    }
+    return queries;
+}
+
+// слова с распределением, близким к закону Ципфа: первые слова словаря встречаются чаще всего
+string GenerateZipfText(mt19937& generator, const vector<string>& dictionary, int word_count) {
+    string text;
+    for (int i = 0; i < word_count; ++i) {
+        if (!text.empty()) {
+            text.push_back(' ');
+        }
+        const double rank = exp(uniform_real_distribution<>(0, log(dictionary.size()))(generator));
+        text += dictionary[min<size_t>(dictionary.size() - 1, static_cast<size_t>(rank) - 1)];
+    }
+    return text;
+}
+
+// прежний SplitIntoWords: слово собирается по символу и копируется в результат
+vector<string> SplitIntoWordsByChar(string_view text) {
+    vector<string> words;
+    string word;
+    for (const char c : text) {
+        if (c == ' ') {
+            if (!word.empty()) {
+                words.push_back(word);
+                word.clear();
+            }
+        } else {
+            word += c;
+        }
+    }
+    if (!word.empty()) {
+        words.push_back(word);
+    }
+    return words;
+}
+
+} // namespace
+
+void BenchmarkIngestion() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 25'000, 10);
+    for (const int document_count : {5'000, 10'000, 20'000, 40'000}) {
+        const auto documents = GenerateQueries(generator, dictionary, document_count, 70);
+        SearchServer search_server(dictionary[0]);
+        LOG_DURATION("AddDocument x "s + to_string(document_count));
+        for (int i = 0; i < document_count; ++i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+        }
+    }
+}
+
+void BenchmarkBatchIngestion() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 25'000, 10);
+    const auto texts = GenerateQueries(generator, dictionary, 100'000, 70);
+    vector<DocumentInput> documents(texts.size());
+    for (size_t i = 0; i < texts.size(); ++i) {
+        documents[i] = {static_cast<int>(i), texts[i], DocumentStatus::ACTUAL, {1, 2, 3}};
+    }
+    {
+        SearchServer search_server(dictionary[0]);
+        LOG_DURATION("AddDocument x 100000"s);
+        for (const DocumentInput& document : documents) {
+            search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+        }
+    }
+    {
+        SearchServer search_server(dictionary[0]);
+        LOG_DURATION("AddDocuments seq x 100000"s);
+        search_server.AddDocuments(execution::seq, documents);
+    }
+    {
+        SearchServer search_server(dictionary[0]);
+        LOG_DURATION("AddDocuments par x 100000"s);
+        search_server.AddDocuments(execution::par, documents);
+    }
+}
+
+void BenchmarkDynamicPruning() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 20'000, 10);
+    SearchServer search_server(""s);
+    for (int i = 0; i < 50'000; ++i) {
+        search_server.AddDocument(i, GenerateZipfText(generator, dictionary, 50), DocumentStatus::ACTUAL, {i % 10});
+    }
+    vector<string> queries;
+    for (int i = 0; i < 200; ++i) {
+        queries.push_back(GenerateZipfText(generator, dictionary, 4));
+    }
+    SearchOptions exhaustive;
+    SearchOptions pruning;
+    pruning.dynamic_pruning = true;
+    vector<vector<Document>> expected(queries.size());
+    vector<vector<Document>> actual(queries.size());
+    {
+        LOG_DURATION("Exhaustive top-5"s);
+        for (size_t i = 0; i < queries.size(); ++i) {
+            expected[i] = search_server.FindTopDocuments(queries[i], exhaustive);
+        }
+    }
+    {
+        LOG_DURATION("Block-Max WAND top-5"s);
+        for (size_t i = 0; i < queries.size(); ++i) {
+            actual[i] = search_server.FindTopDocuments(queries[i], pruning);
+        }
+    }
+    int mismatches = 0;
+    for (size_t i = 0; i < queries.size(); ++i) {
+        mismatches += !equal(expected[i].begin(), expected[i].end(), actual[i].begin(), actual[i].end(),
+                             [](const Document& lhs, const Document& rhs) {
+                                 return lhs.id == rhs.id;
+                             });
+    }
+    cerr << "Mismatched queries: "s << mismatches << endl;
+}
+
+void BenchmarkPreparedQueries() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 20'000, 10);
+    SearchServer search_server(""s);
+    for (int i = 0; i < 20'000; ++i) {
+        search_server.AddDocument(i, GenerateZipfText(generator, dictionary, 50), DocumentStatus::ACTUAL, {i % 10});
+    }
+    vector<string> queries;
+    for (int i = 0; i < 100; ++i) {
+        queries.push_back(GenerateZipfText(generator, dictionary, 4));
+    }
+    vector<SearchServer::PreparedQuery> prepared;
+    for (const string& query : queries) {
+        prepared.push_back(search_server.PrepareQuery(query));
+    }
+    size_t result_count = 0;
+    {
+        LOG_DURATION("FindTopDocuments raw x 100 x 10"s);
+        for (int round = 0; round < 10; ++round) {
+            for (const string& query : queries) {
+                result_count += search_server.FindTopDocuments(query).size();
+            }
+        }
+    }
+    {
+        LOG_DURATION("FindTopDocuments prepared x 100 x 10"s);
+        vector<Document> result;
+        for (int round = 0; round < 10; ++round) {
+            for (const auto& query : prepared) {
+                search_server.FindTopDocuments(query, [](int, DocumentStatus status, int) {
+                    return status == DocumentStatus::ACTUAL;
+                }, SearchOptions(), result);
+                result_count -= result.size();
+            }
+        }
+    }
+    cerr << "Result difference: "s << result_count << endl;
+}
+
+void BenchmarkTokenizer() {
+    mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 25'000, 10);
+    const auto texts = GenerateQueries(generator, dictionary, 100'000, 70);
+    size_t word_count = 0;
+    {
+        LOG_DURATION("SplitIntoWords by char x 100000"s);
+        for (const string& text : texts) {
+            word_count += SplitIntoWordsByChar(text).size();
+        }
+    }
+    {
+        LOG_DURATION("SplitIntoWords string_view x 100000"s);
+        for (const string& text : texts) {
+            word_count += SplitIntoWords(text).size();
+        }
+    }
+    {
+        LOG_DURATION("SplitIntoWords into buffer x 100000"s);
+        vector<string_view> words;
+        for (const string& text : texts) {
+            SplitIntoWords(text, words);
+            word_count += words.size();
+        }
+    }
+    {
+        // запрос: короткий текст, разбирается целиком вместе с проверкой слов
+        const auto queries = GenerateQueries(generator, dictionary, 1'000'000, 5);
+        vector<string_view> words;
+        LOG_DURATION("SplitIntoWords queries x 1000000"s);
+        for (const string& query : queries) {
+            SplitIntoWords(query, words);
+            word_count += words.size();
+        }
+    }
+    cerr << "Words: "s << word_count << endl;
+}
+
+namespace {
+
+// Тексты с небольшим словарём, чтобы у запросов было много совпадений
+string GenerateSmallText(mt19937& generator, int vocabulary, int max_word_count) {
+    string text;
+    const int word_count = uniform_int_distribution(1, max_word_count)(generator);
+    for (int i = 0; i < word_count; ++i) {
+        if (!text.empty()) {
+            text.push_back(' ');
+        }
+        text += "w"s + to_string(uniform_int_distribution(0, vocabulary - 1)(generator));
+    }
+    return text;
+}
+
+string GenerateSmallQuery(mt19937& generator, int vocabulary) {
+    string query = GenerateSmallText(generator, vocabulary, 3);
+    if (generator() % 2 == 0) {
+        query += " -w"s + to_string(uniform_int_distribution(0, vocabulary - 1)(generator));
+    }
+    return query;
+}
+
+vector<int> GetIds(const vector<Document>& documents) {
+    vector<int> ids;
+    for (const Document& document : documents) {
+        ids.push_back(document.id);
+    }
+    return ids;
+}
+
+void AssertSameDocuments(const vector<Document>& lhs, const vector<Document>& rhs, const string& hint) {
+    AssertEqual(GetIds(lhs), GetIds(rhs), hint);
+    for (size_t i = 0; i < lhs.size(); ++i) {
+        Assert(abs(lhs[i].relevance - rhs[i].relevance) < 1e-9, hint + ": relevance of "s + to_string(lhs[i].id));
+        AssertEqual(lhs[i].rating, rhs[i].rating, hint);
+    }
+}
+
+string MakeTempPath(const string& name) {
+    return (filesystem::temp_directory_path() / (name + "_"s + to_string(random_device()()))).string();
+}
+
+void TestSnapshotRoundTrip() {
+    mt19937 generator(1);
+    SearchServer search_server("w0"s);
+    for (int i = 0; i < 500; ++i) {
+        search_server.AddDocument(i * 2, GenerateSmallText(generator, 60, 8), static_cast<DocumentStatus>(i % 3), {i % 7, 1});
+    }
+    for (int i = 0; i < 100; ++i) {
+        search_server.RemoveDocument(i * 6);
+    }
+    const string path = MakeTempPath("snapshot"s);
+    search_server.SaveSnapshot(path);
+    {
+        const SearchServer loaded = SearchServer::OpenSnapshot(path);
+        ASSERT_EQUAL(loaded.GetDocumentCount(), search_server.GetDocumentCount());
+        for (int i = 0; i < 100; ++i) {
+            const string query = GenerateSmallQuery(generator, 60);
+            AssertSameDocuments(loaded.FindTopDocuments(query), search_server.FindTopDocuments(query), query);
+            AssertSameDocuments(loaded.FindTopDocuments(query, DocumentStatus::BANNED), search_server.FindTopDocuments(query, DocumentStatus::BANNED), query);
+        }
+        ASSERT(get<0>(loaded.MatchDocument("w1 w2 w3"s, 2)) == get<0>(search_server.MatchDocument("w1 w2 w3"s, 2)));
+    }
+    // испорченный файл не открывается
+    {
+        fstream file(path, ios::in | ios::out | ios::binary);
+        file.seekp(-3, ios::end);
+        file.put('\x7f');
+    }
+    bool corrupted = false;
+    try {
+        SearchServer::OpenSnapshot(path);
+    } catch (const runtime_error&) {
+        corrupted = true;
+    }
+    ASSERT(corrupted);
+    filesystem::remove(path);
+}
+
+void TestSnapshotResave() {
+    const string path = MakeTempPath("resave"s);
+    {
+        SearchServer search_server("and"s);
+        search_server.AddDocument(1, "white cat and fancy collar"s, DocumentStatus::ACTUAL, {8, -3});
+        search_server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
+        search_server.SaveSnapshot(path);
+    }
+    {
+        // словарь, сегменты и прямой индекс открытого сервера ссылаются на файл, который перезаписывается
+        SearchServer search_server = SearchServer::OpenSnapshot(path);
+        search_server.AddDocument(3, "groomed dog expressive eyes"s, DocumentStatus::ACTUAL, {5, -12, 2, 1});
+        search_server.RemoveDocument(1);
+        const auto expected = search_server.FindTopDocuments("fluffy groomed cat"s);
+        search_server.SaveSnapshot(path);
+        ASSERT(!filesystem::exists(path + ".tmp"s));
+        AssertSameDocuments(search_server.FindTopDocuments("fluffy groomed cat"s), expected, "saved server"s);
+        search_server.SaveSnapshot(path);
+        const SearchServer reloaded = SearchServer::OpenSnapshot(path);
+        ASSERT_EQUAL(reloaded.GetDocumentCount(), 2);
+        AssertSameDocuments(reloaded.FindTopDocuments("fluffy groomed cat"s), expected, "reloaded server"s);
+    }
+    // неудачное сохранение не трогает прежний снимок
+    bool threw = false;
+    try {
+        SearchServer(""s).SaveSnapshot(path + "_missing_directory/snapshot"s);
+    } catch (const runtime_error&) {
+        threw = true;
+    }
+    ASSERT(threw);
+    ASSERT_EQUAL(SearchServer::OpenSnapshot(path).GetDocumentCount(), 2);
+    filesystem::remove(path);
+}
+
+void TestTombstonesAndCompact() {
+    SearchServer search_server(""s);
+    search_server.AddDocument(1, "cat dog"s, DocumentStatus::ACTUAL, {1});
+    search_server.AddDocument(2, "cat bird"s, DocumentStatus::ACTUAL, {2});
+    search_server.AddDocument(3, "cat fish"s, DocumentStatus::ACTUAL, {3});
+    search_server.RemoveDocument(2);
+    search_server.RemoveDocument(2);
+    search_server.RemoveDocument(100);
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 2);
+    ASSERT_EQUAL(GetIds(search_server.FindTopDocuments("cat bird"s)), (vector<int>{3, 1}));
+    ASSERT(search_server.GetDocumentTerms(2).empty());
+    const auto before = search_server.FindTopDocuments("cat dog fish"s);
+    search_server.Compact();
+    AssertSameDocuments(search_server.FindTopDocuments("cat dog fish"s), before, "after Compact"s);
+    // удалённый id можно добавить заново
+    search_server.AddDocument(2, "bird"s, DocumentStatus::ACTUAL, {5});
+    ASSERT_EQUAL(GetIds(search_server.FindTopDocuments("bird"s)), vector<int>{2});
+    bool threw = false;
+    try {
+        search_server.MatchDocument("cat"s, 100);
+    } catch (const out_of_range&) {
+        threw = true;
+    }
+    ASSERT(threw);
+}
+
+void TestForwardIndexRepack() {
+    ForwardIndex index;
+    const auto make_terms = [](int document_id) {
+        vector<TermFrequency> terms;
+        for (TermId term_id = 0; term_id < 20; ++term_id) {
+            terms.push_back({term_id * 7 + static_cast<TermId>(document_id % 5), 0, document_id * 1.0});
+        }
+        return terms;
+    };
+    for (int i = 0; i < 3000; ++i) {
+        index.Add(i, make_terms(i));
+    }
+    // удалённые не копятся без Compact: половина записей - и индекс перепаковывается
+    for (int i = 0; i < 3000; ++i) {
+        if (i % 10 != 0) {
+            index.Remove(i);
+        }
+        // у документа 20 слов и отрезок
+        ASSERT(index.GetRemovedEntryCount() < 16 * 1024 || index.GetRemovedEntryCount() < index.size() * 21);
+    }
+    ASSERT(index.GetRemovedEntryCount() < 16 * 1024);
+    ASSERT_EQUAL(index.size(), 300u);
+    for (int i = 0; i < 3000; i += 10) {
+        const DocumentTerms terms = index.Find(i);
+        const vector<TermFrequency> expected = make_terms(i);
+        ASSERT_EQUAL(terms.size(), expected.size());
+        for (size_t j = 0; j < expected.size(); ++j) {
+            ASSERT_EQUAL(terms.begin()[j].term_id, expected[j].term_id);
+            ASSERT_EQUAL(terms.begin()[j].freq, expected[j].freq);
+        }
+    }
+}
+
+// номер первого слова с управляющим символом или число слов, как у SplitIntoWords
+size_t FindInvalidWordByChar(const vector<string>& words) {
+    for (size_t i = 0; i < words.size(); ++i) {
+        if (any_of(words[i].begin(), words[i].end(), [](char c) {
+                return static_cast<unsigned char>(c) < ' ';
+            })) {
+            return i;
+        }
+    }
+    return words.size();
+}
+
+void AssertSameSplit(const string& text) {
+    const vector<string> expected = SplitIntoWordsByChar(text);
+    const string hint = "text of "s + to_string(text.size()) + " bytes"s;
+    const vector<string_view> words = SplitIntoWords(text);
+    AssertEqual(vector<string>(words.begin(), words.end()), expected, hint);
+    // буфер с прежними словами очищается
+    vector<string_view> buffer{"stale"sv};
+    const size_t invalid_word = SplitIntoWords(text, buffer);
+    AssertEqual(vector<string>(buffer.begin(), buffer.end()), expected, hint);
+    AssertEqual(invalid_word, FindInvalidWordByChar(expected), hint);
+}
+
+void TestSplitIntoWords() {
+    mt19937 generator(6);
+    // длины около границ 16-, 32- и 64-байтных блоков
+    const vector<size_t> lengths = {0, 1, 15, 16, 17, 31, 32, 33, 63, 64, 65, 127, 128, 129, 200};
+    for (const size_t length : lengths) {
+        for (const int space_percent : {0, 5, 30, 70, 100}) {
+            for (int i = 0; i < 20; ++i) {
+                string text(length, ' ');
+                for (char& c : text) {
+                    if (uniform_int_distribution(0, 99)(generator) >= space_percent) {
+                        c = uniform_int_distribution('a', 'z')(generator);
+                    }
+                }
+                AssertSameSplit(text);
+            }
+        }
+    }
+    // серии пробелов в начале и в конце, слова через границы блоков
+    for (const size_t spaces : {size_t{0}, size_t{1}, size_t{16}, size_t{63}, size_t{64}, size_t{65}}) {
+        AssertSameSplit(string(spaces, ' ') + "word"s + string(spaces, ' '));
+        AssertSameSplit(string(spaces, ' ') + string(70, 'x') + " "s + string(60, 'y') + string(spaces, ' '));
+    }
+    AssertSameSplit(string(62, 'a') + " "s + string(3, 'b') + "  "s + string(28, 'c'));
+    // управляющий символ в каждой позиции двух блоков и хвоста;
+    // байты от 0x7F не управляющие, в том числе при знаковом char
+    string base;
+    while (base.size() < 150) {
+        base += string(uniform_int_distribution(1, 9)(generator), 'a') + string(uniform_int_distribution(1, 3)(generator), ' ');
+    }
+    for (const char control : {'\0', '\t', '\x1f', '\x7f', '\x80', '\xff'}) {
+        for (size_t position = 0; position < base.size(); ++position) {
+            string text = base;
+            text[position] = control;
+            AssertSameSplit(text);
+            // второй управляющий символ дальше не меняет номер первого слова
+            text[base.size() - 1] = '\n';
+            AssertSameSplit(text);
+        }
+    }
+}
+
+void TestMatchDocumentParsesEachQuery() {
+    SearchServer search_server(""s);
+    search_server.AddDocument(1, "cat dog"s, DocumentStatus::ACTUAL, {1});
+    search_server.AddDocument(2, "bird fish"s, DocumentStatus::BANNED, {1});
+    // разобранный запрос не переносится из прошлого вызова
+    ASSERT_EQUAL(get<0>(search_server.MatchDocument("cat"s, 1)), vector<string_view>{"cat"sv});
+    ASSERT_EQUAL(get<0>(search_server.MatchDocument("dog bird"s, 1)), vector<string_view>{"dog"sv});
+    ASSERT_EQUAL(get<0>(search_server.MatchDocument("dog bird"s, 2)), vector<string_view>{"bird"sv});
+    ASSERT(get<0>(search_server.MatchDocument("-cat dog"s, 1)).empty());
+    ASSERT_EQUAL(get<0>(search_server.MatchDocument(execution::par, "cat"s, 1)), vector<string_view>{"cat"sv});
+    ASSERT_EQUAL(get<0>(search_server.MatchDocument(execution::par, "fish dog"s, 1)), vector<string_view>{"dog"sv});
+    ASSERT(get<1>(search_server.MatchDocument(execution::par, "fish dog"s, 2)) == DocumentStatus::BANNED);
+}
+
+void AssertSameMatches(const vector<SearchServer::matchtuple>& actual, const vector<SearchServer::matchtuple>& expected, const string& hint) {
+    ASSERT_EQUAL(actual.size(), expected.size());
+    for (size_t i = 0; i < actual.size(); ++i) {
+        AssertEqual(get<0>(actual[i]), get<0>(expected[i]), hint);
+        Assert(get<1>(actual[i]) == get<1>(expected[i]), hint);
+    }
+}
+
+void TestMatchDocuments() {
+    mt19937 generator(7);
+    SearchServer search_server("w0"s);
+    search_server.SetThreadCount(3);
+    // пакеты разного размера и отдельные документы дают несколько сегментов
+    vector<string> texts;
+    texts.reserve(1100);
+    int id = 0;
+    for (const int batch_size : {300, 200, 500}) {
+        vector<DocumentInput> documents;
+        for (int i = 0; i < batch_size; ++i, ++id) {
+            texts.push_back(GenerateSmallText(generator, 60, 8));
+            documents.push_back({id, texts.back(), static_cast<DocumentStatus>(id % 3), {id % 5}});
+        }
+        search_server.AddDocuments(documents);
+    }
+    for (; id < 1100; ++id) {
+        search_server.AddDocument(id, GenerateSmallText(generator, 60, 8), static_cast<DocumentStatus>(id % 3), {id % 5});
+    }
+    for (int removed = 0; removed < 1100; removed += 7) {
+        search_server.RemoveDocument(removed);
+    }
+    vector<int> ids(search_server.begin(), search_server.end());
+    shuffle(ids.begin(), ids.end(), generator);
+
+    vector<string> queries = {"w1 w2 -w3"s, "-w4 w4"s, "w0 w5"s};
+    for (int i = 0; i < 20; ++i) {
+        queries.push_back(GenerateSmallQuery(generator, 60));
+    }
+    for (const string& query : queries) {
+        vector<SearchServer::matchtuple> expected;
+        for (const int document_id : ids) {
+            expected.push_back(search_server.MatchDocument(query, document_id));
+        }
+        AssertSameMatches(search_server.MatchDocuments(query, ids), expected, query);
+        AssertSameMatches(search_server.MatchDocuments(execution::seq, query, ids), expected, query);
+        // не меньше 64 документов на часть: ids хватает на несколько частей
+        AssertSameMatches(search_server.MatchDocuments(execution::par, query, ids), expected, query);
+        AssertSameMatches(search_server.MatchDocuments(PoolExecutionPolicy{100}, query, ids), expected, query);
+    }
+
+    // минус-слово подавляет совпадения во всех сегментах
+    const auto matches = search_server.MatchDocuments(execution::par, "w1 w2 -w3"s, ids);
+    set<int> with_minus_word;
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (!get<0>(search_server.MatchDocument("w3"s, ids[i])).empty()) {
+            with_minus_word.insert(ids[i]);
+            ASSERT(get<0>(matches[i]).empty());
+        }
+    }
+    ASSERT(!with_minus_word.empty());
+    ASSERT(*with_minus_word.begin() < 300 && *with_minus_word.rbegin() >= 1000);
+
+    for (const int missing_id : {7, 5000}) {
+        vector<int> invalid_ids = ids;
+        invalid_ids.insert(invalid_ids.begin() + 500, missing_id);
+        int thrown = 0;
+        try {
+            search_server.MatchDocuments("w1"s, invalid_ids);
+        } catch (const out_of_range&) {
+            ++thrown;
+        }
+        try {
+            search_server.MatchDocuments(execution::par, "w1"s, invalid_ids);
+        } catch (const out_of_range&) {
+            ++thrown;
+        }
+        ASSERT_EQUAL(thrown, 2);
+    }
+}
+
+void TestConcurrentReadWrite() {
+    mt19937 generator(2);
+    const int DOCUMENT_COUNT = 1500;
+    vector<string> texts;
+    for (int i = 0; i < DOCUMENT_COUNT; ++i) {
+        texts.push_back(GenerateSmallText(generator, 80, 10));
+    }
+    vector<string> queries;
+    for (int i = 0; i < 50; ++i) {
+        queries.push_back(GenerateSmallQuery(generator, 80));
+    }
+    SearchServer search_server(""s);
+    atomic<bool> done = false;
+    atomic<int> bad_results = 0;
+    const auto reader = [&] {
+        size_t index = 0;
+        while (!done) {
+            const auto documents = search_server.FindTopDocuments(queries[index++ % queries.size()]);
+            for (size_t i = 1; i < documents.size(); ++i) {
+                if (IsMoreRelevant(documents[i], documents[i - 1])) {
+                    ++bad_results;
+                }
+            }
+            search_server.GetDocumentCount();
+        }
+    };
+    thread first_reader(reader);
+    thread second_reader(reader);
+    for (int i = 0; i < DOCUMENT_COUNT; ++i) {
+        search_server.AddDocument(i, texts[i], DocumentStatus::ACTUAL, {i % 5});
+        if (i % 3 == 2) {
+            search_server.RemoveDocument(i - 1);
+        }
+    }
+    done = true;
+    first_reader.join();
+    second_reader.join();
+    ASSERT_EQUAL(bad_results.load(), 0);
+
+    // после всех слияний выдача та же, что у сервера, собранного сразу
+    SearchServer expected(""s);
+    for (int i = 0; i < DOCUMENT_COUNT; ++i) {
+        if (i % 3 != 1) {
+            expected.AddDocument(i, texts[i], DocumentStatus::ACTUAL, {i % 5});
+        }
+    }
+    ASSERT_EQUAL(search_server.GetDocumentCount(), expected.GetDocumentCount());
+    for (const string& query : queries) {
+        AssertSameDocuments(search_server.FindTopDocuments(query), expected.FindTopDocuments(query), query);
+    }
+}
+
+void TestParallelSearchMatchesSequential() {
+    mt19937 generator(3);
+    SearchServer search_server(""s);
+    search_server.SetThreadCount(3);
+    vector<string> texts;
+    vector<DocumentInput> documents;
+    for (int i = 0; i < 6000; ++i) {
+        texts.push_back(GenerateSmallText(generator, 200, 12));
+    }
+    for (int i = 0; i < 6000; ++i) {
+        documents.push_back({i, texts[i], static_cast<DocumentStatus>(i % 4), {i % 9}});
+    }
+    search_server.AddDocuments(execution::par, documents);
+    for (int i = 0; i < 200; ++i) {
+        const string query = GenerateSmallQuery(generator, 200);
+        const auto expected = search_server.FindTopDocuments(execution::seq, query, DocumentStatus::IRRELEVANT);
+        for (const size_t grain : {size_t{0}, size_t{500}, size_t{1000}}) {
+            const auto actual = search_server.FindTopDocuments(PoolExecutionPolicy{grain}, query, DocumentStatus::IRRELEVANT);
+            ASSERT_EQUAL(GetIds(actual), GetIds(expected));
+            for (size_t j = 0; j < actual.size(); ++j) {
+                // диапазоны складывают релевантность в том же порядке
+                ASSERT_EQUAL(actual[j].relevance, expected[j].relevance);
+            }
+        }
+        SearchOptions pruning;
+        pruning.dynamic_pruning = true;
+        AssertSameDocuments(search_server.FindTopDocuments(query, pruning), search_server.FindTopDocuments(query), query);
+        const auto prepared = search_server.PrepareQuery(query);
+        AssertSameDocuments(search_server.FindTopDocuments(prepared), search_server.FindTopDocuments(query), query);
+    }
+}
+
+void TestUnboundedTopK() {
+    SearchServer search_server(""s);
+    ShardedSearchServer sharded(""s, 3);
+    for (int i = 0; i < 10; ++i) {
+        search_server.AddDocument(i, "cat number "s + to_string(i), DocumentStatus::ACTUAL, {i});
+        sharded.AddDocument(i, "cat number "s + to_string(i), DocumentStatus::ACTUAL, {i});
+    }
+    // top_k + offset не должно переполняться: SIZE_MAX - "все документы после offset"
+    SearchOptions all;
+    all.top_k = SIZE_MAX;
+    all.offset = 2;
+    const auto expected = search_server.FindTopDocuments("cat"s, all);
+    ASSERT_EQUAL(expected.size(), 8u);
+    ASSERT_EQUAL(expected.front().id, 7);
+    AssertSameDocuments(search_server.FindTopDocuments(PoolExecutionPolicy{1}, "cat"s, DocumentStatus::ACTUAL, all), expected, "ranges"s);
+    AssertSameDocuments(search_server.FindTopDocuments(search_server.PrepareQuery("cat"s), DocumentStatus::ACTUAL, all), expected, "prepared"s);
+    AssertSameDocuments(sharded.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, all), expected, "sharded"s);
+    all.dynamic_pruning = true;
+    AssertSameDocuments(search_server.FindTopDocuments("cat"s, all), expected, "pruning"s);
+    ASSERT_EQUAL(SelectTopDocuments(expected, SIZE_MAX, 2).size(), 6u);
+}
+
+void TestThreadPool() {
+    ThreadPool pool(3);
+    vector<int> values(10'000);
+    pool.ParallelFor(values.size(), 7, [&values, &pool](size_t i) {
+        // вложенный вызов из работника не должен блокировать пул
+        atomic<int> inner = 0;
+        pool.ParallelFor(4, 1, [&inner](size_t) {
+            ++inner;
+        });
+        values[i] = static_cast<int>(i) + inner;
+    });
+    for (size_t i = 0; i < values.size(); ++i) {
+        ASSERT_EQUAL(values[i], static_cast<int>(i) + 4);
+    }
+    bool threw = false;
+    try {
+        pool.ParallelFor(1000, 10, [](size_t i) {
+            if (i == 555) {
+                throw logic_error("chunk failed"s);
+            }
+        });
+    } catch (const logic_error&) {
+        threw = true;
+    }
+    ASSERT(threw);
+
+    // ожидая свои куски, вызывающий поток не выполняет чужие задачи: он может держать блокировку
+    thread_local bool inside_call = false;
+    atomic<bool> released = false;
+    atomic<int> foreign_inside = 0;
+    {
+        ThreadPool busy_pool(2);
+        const auto foreign_task = [&released, &foreign_inside](bool blocking) {
+            return [&released, &foreign_inside, blocking] {
+                if (inside_call) {
+                    ++foreign_inside;
+                    return;
+                }
+                while (blocking && !released) {
+                    this_thread::yield();
+                }
+            };
+        };
+        // работники заняты, задачи-помощники ParallelFor встают в очереди за чужими
+        busy_pool.Submit(foreign_task(true));
+        busy_pool.Submit(foreign_task(true));
+        for (int i = 0; i < 10; ++i) {
+            busy_pool.Submit(foreign_task(false));
+        }
+        inside_call = true;
+        busy_pool.ParallelFor(100, 1, [](size_t) {});
+        inside_call = false;
+        released = true;
+    }
+    ASSERT_EQUAL(foreign_inside.load(), 0);
+}
+
+void TestQueryCacheInvalidation() {
+    SearchServer search_server(""s);
+    search_server.SetQueryCacheBudget(1 << 20);
+    search_server.AddDocument(1, "cat dog"s, DocumentStatus::ACTUAL, {1});
+    search_server.AddDocument(2, "cat"s, DocumentStatus::ACTUAL, {1});
+    search_server.AddDocument(10, "fish"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(GetIds(search_server.FindTopDocuments("cat -bird"s)), (vector<int>{2, 1}));
+    ASSERT_EQUAL(GetIds(search_server.FindTopDocuments("cat -bird"s)), (vector<int>{2, 1}));
+    ASSERT_EQUAL(search_server.GetQueryCacheStats().hits, 1u);
+    // после записи прежняя выдача из кэша не возвращается
+    search_server.AddDocument(3, "cat cat"s, DocumentStatus::ACTUAL, {5});
+    ASSERT_EQUAL(GetIds(search_server.FindTopDocuments("cat -bird"s)), (vector<int>{3, 2, 1}));
+    search_server.AddDocument(4, "cat bird"s, DocumentStatus::ACTUAL, {1});
+    search_server.RemoveDocument(3);
+    ASSERT_EQUAL(GetIds(search_server.FindTopDocuments("cat -bird"s)), (vector<int>{2, 1}));
+    ASSERT_EQUAL(search_server.GetQueryCacheStats().hits, 1u);
+}
+
+void TestDuplicatePolicy() {
+    SearchServer search_server("and"s);
+    search_server.AddDocument(1, "cat dog"s, DocumentStatus::ACTUAL, {});
+    // до включения проверки дубликаты добавляются
+    search_server.AddDocument(2, "dog cat cat and"s, DocumentStatus::ACTUAL, {});
+    search_server.SetDuplicatePolicy(DuplicatePolicy::REJECT);
+    bool threw = false;
+    try {
+        search_server.AddDocument(3, "dog and cat"s, DocumentStatus::ACTUAL, {});
+    } catch (const invalid_argument&) {
+        threw = true;
+    }
+    ASSERT(threw);
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 2);
+    search_server.RemoveDocument(1);
+    search_server.RemoveDocument(2);
+    search_server.AddDocument(3, "dog cat"s, DocumentStatus::ACTUAL, {});
+    search_server.SetDuplicatePolicy(DuplicatePolicy::FLAG);
+    search_server.AddDocuments({{4, "cat dog"s, DocumentStatus::ACTUAL, {}}, {5, "bird"s, DocumentStatus::ACTUAL, {}}, {6, "bird bird"s, DocumentStatus::ACTUAL, {}}});
+    ASSERT_EQUAL(search_server.GetFlaggedDuplicates(), (map<int, int>{{4, 3}, {6, 5}}));
+    search_server.SetDuplicatePolicy(DuplicatePolicy::REJECT);
+    threw = false;
+    try {
+        search_server.AddDocuments({{7, "fish"s, DocumentStatus::ACTUAL, {}}, {8, "fish"s, DocumentStatus::ACTUAL, {}}});
+    } catch (const invalid_argument&) {
+        threw = true;
+    }
+    // при ошибке пакет не добавляется целиком
+    ASSERT(threw);
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 4);
+    search_server.RemoveDocument(4);
+    ASSERT_EQUAL(search_server.GetFlaggedDuplicates(), (map<int, int>{{6, 5}}));
+}
+
+void TestRemoveDuplicates() {
+    SearchServer search_server("and with"s);
+    search_server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    search_server.AddDocument(2, "funny pet with curly hair"s, DocumentStatus::ACTUAL, {1, 2});
+    search_server.AddDocument(3, "funny pet with curly hair"s, DocumentStatus::ACTUAL, {1, 2});
+    search_server.AddDocument(4, "funny pet and curly hair"s, DocumentStatus::ACTUAL, {1, 2});
+    search_server.AddDocument(5, "funny funny pet and nasty nasty rat"s, DocumentStatus::ACTUAL, {1, 2});
+    search_server.AddDocument(6, "funny pet and not very nasty rat"s, DocumentStatus::ACTUAL, {1, 2});
+    search_server.AddDocument(7, "very nasty rat and not very funny pet"s, DocumentStatus::ACTUAL, {1, 2});
+    search_server.AddDocument(8, "pet with rat and rat and rat"s, DocumentStatus::ACTUAL, {1, 2});
+    search_server.AddDocument(9, "nasty rat with curly hair"s, DocumentStatus::ACTUAL, {1, 2});
+    ostringstream output;
+    auto* const old_buffer = cout.rdbuf(output.rdbuf());
+    RemoveDuplicates(search_server);
+    cout.rdbuf(old_buffer);
+    ASSERT_EQUAL(output.str(), "Found duplicate document id 3\nFound duplicate document id 4\n"
+                               "Found duplicate document id 5\nFound duplicate document id 7\n"s);
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 5);
+}
+
+void TestNearDuplicateIndex() {
+    SearchServer search_server(""s);
+    search_server.AddDocument(1, "a b c d e f g h i j"s, DocumentStatus::ACTUAL, {});
+    search_server.AddDocument(2, "a b c d e f g h i k"s, DocumentStatus::ACTUAL, {});
+    search_server.AddDocument(3, "a b c d e f g h i j l"s, DocumentStatus::ACTUAL, {});
+    search_server.AddDocument(4, "p q r s t u v w x y"s, DocumentStatus::ACTUAL, {});
+    search_server.AddDocument(5, "a b c p q r"s, DocumentStatus::ACTUAL, {});
+    NearDuplicateOptions options;
+    options.jaccard_threshold = 0.8;
+    const auto groups = FindNearDuplicates(search_server, options);
+    ASSERT_EQUAL(groups.size(), 1u);
+    ASSERT_EQUAL(groups[0].document_id, 1);
+    ASSERT_EQUAL(groups[0].duplicates, (vector<int>{2, 3}));
+    ASSERT(abs(ComputeJaccard(search_server.GetDocumentTerms(1), search_server.GetDocumentTerms(3)) - 10.0 / 11) < 1e-12);
+
+    NearDuplicateIndex index(search_server, options);
+    ASSERT(index.Add(1).empty());
+    ASSERT_EQUAL(index.Add(3), vector<int>{1});
+    // у 2 и 3 общих слов 9 из 12: друг на друга они не похожи
+    ASSERT_EQUAL(index.FindSimilar(2), vector<int>{1});
+    index.Remove(1);
+    ASSERT(index.FindSimilar(2).empty());
+    ASSERT_EQUAL(index.size(), 1u);
+    ASSERT_EQUAL(index.Add(1), vector<int>{3});
+
+    ostringstream output;
+    auto* const old_buffer = cout.rdbuf(output.rdbuf());
+    RemoveNearDuplicates(search_server, options);
+    cout.rdbuf(old_buffer);
+    ASSERT_EQUAL(output.str(), "Found near-duplicate document id 2\nFound near-duplicate document id 3\n"s);
+    ASSERT(FindNearDuplicates(search_server, options).empty());
+
+    bool threw = false;
+    try {
+        options.jaccard_threshold = 0;
+        NearDuplicateIndex invalid(search_server, options);
+    } catch (const invalid_argument&) {
+        threw = true;
+    }
+    ASSERT(threw);
+}
+
+void TestServerNearDuplicateIndex() {
+    SearchServer search_server(""s);
+    search_server.AddDocument(1, "a b c d e f g h i j"s, DocumentStatus::ACTUAL, {});
+    search_server.AddDocument(4, "p q r s t u v w x y"s, DocumentStatus::ACTUAL, {});
+    ASSERT(search_server.FindSimilarDocuments(1).empty());
+    NearDuplicateOptions options;
+    options.jaccard_threshold = 0.8;
+    search_server.EnableNearDuplicateIndex(options);
+    // документы, добавленные после включения, попадают в индекс и по одному, и пакетом
+    search_server.AddDocument(2, "a b c d e f g h i k"s, DocumentStatus::ACTUAL, {});
+    search_server.AddDocuments(execution::par, {{3, "a b c d e f g h i j l"s, DocumentStatus::ACTUAL, {}}, {5, "p q r s t u v l m n"s, DocumentStatus::ACTUAL, {}}});
+    ASSERT_EQUAL(search_server.FindSimilarDocuments(1), (vector<int>{2, 3}));
+    ASSERT_EQUAL(search_server.FindSimilarDocuments(3), vector<int>{1});
+    ASSERT(search_server.FindSimilarDocuments(5).empty());
+    // удалённый документ уходит из индекса, а Compact не ломает виды прямого индекса
+    search_server.RemoveDocument(1);
+    search_server.Compact();
+    ASSERT(search_server.FindSimilarDocuments(1).empty());
+    ASSERT(search_server.FindSimilarDocuments(2).empty());
+    ASSERT(search_server.FindSimilarDocuments(3).empty());
+    search_server.AddDocument(6, "a b c d e f g h i k l"s, DocumentStatus::ACTUAL, {});
+    ASSERT_EQUAL(search_server.FindSimilarDocuments(6), (vector<int>{2, 3}));
+    search_server.DisableNearDuplicateIndex();
+    ASSERT(search_server.FindSimilarDocuments(6).empty());
+
+    // поиск похожих одновременно с записью, удаления перепаковывают прямой индекс
+    mt19937 generator(8);
+    vector<string> texts;
+    for (int i = 0; i < 2000; ++i) {
+        texts.push_back(GenerateSmallText(generator, 60, 30));
+    }
+    SearchServer concurrent(""s);
+    concurrent.EnableNearDuplicateIndex();
+    atomic<bool> done = false;
+    thread reader([&concurrent, &done] {
+        while (!done) {
+            for (int id = 0; id < 2000; id += 97) {
+                for (const int similar : concurrent.FindSimilarDocuments(id)) {
+                    ASSERT(similar != id);
+                }
+            }
+        }
+    });
+    for (int i = 0; i < 2000; ++i) {
+        concurrent.AddDocument(i, texts[i], DocumentStatus::ACTUAL, {});
+        if (i % 4 != 0) {
+            concurrent.RemoveDocument(i - 1);
+        }
+    }
+    done = true;
+    reader.join();
+    // индекс сервера совпадает с построенным заново по его документам
+    NearDuplicateIndex fresh(concurrent);
+    fresh.AddDocuments(vector<int>(concurrent.begin(), concurrent.end()));
+    for (const int id : concurrent) {
+        ASSERT_EQUAL(concurrent.FindSimilarDocuments(id), fresh.FindSimilar(id));
+    }
+}
+
+void TestShardedSearchServer() {
+    mt19937 generator(4);
+    vector<string> texts;
+    for (int i = 0; i < 1500; ++i) {
+        texts.push_back(GenerateSmallText(generator, 150, 10));
+    }
+    for (const size_t shard_count : {size_t{1}, size_t{3}, size_t{7}}) {
+        SearchServer single("w0"s);
+        ShardedSearchServer sharded("w0"s, shard_count);
+        ASSERT_EQUAL(sharded.GetShardCount(), shard_count);
+        for (int i = 0; i < 1500; ++i) {
+            const auto status = static_cast<DocumentStatus>(i % 3);
+            single.AddDocument(i * 3, texts[i], status, {i % 7});
+            sharded.AddDocument(i * 3, texts[i], status, {i % 7});
+        }
+        for (int i = 0; i < 300; ++i) {
+            const int id = uniform_int_distribution(0, 1499)(generator) * 3;
+            single.RemoveDocument(id);
+            sharded.RemoveDocument(id);
+        }
+        ASSERT_EQUAL(sharded.GetDocumentCount(), single.GetDocumentCount());
+        SearchOptions deep;
+        deep.top_k = 7;
+        deep.offset = 3;
+        for (int i = 0; i < 100; ++i) {
+            const string query = GenerateSmallQuery(generator, 150);
+            AssertSameDocuments(sharded.FindTopDocuments(query), single.FindTopDocuments(query), query);
+            AssertSameDocuments(sharded.FindTopDocuments(query, DocumentStatus::BANNED, deep), single.FindTopDocuments(query, DocumentStatus::BANNED, deep), query);
+        }
+        const int id = *single.begin();
+        ASSERT(sharded.MatchDocument("w1 w2 w3"s, id) == single.MatchDocument("w1 w2 w3"s, id));
+    }
+    bool threw = false;
+    try {
+        ShardedSearchServer invalid(""s, 0);
+    } catch (const invalid_argument&) {
+        threw = true;
+    }
+    ASSERT(threw);
+}
+
+// число документов 100, у каждого слова 10 документов; считает обращения
+class CountingStatistics : public CorpusStatistics {
+public:
+    size_t GetDocumentCount() const override {
+        return 100;
+    }
+
+    size_t GetDocumentFrequency(string_view) const override {
+        ++calls;
+        return 10;
+    }
+
+    mutable atomic<int> calls = 0;
+};
+
+void TestQueryCorpusStatistics() {
+    SearchServer search_server(""s);
+    search_server.SetQueryCacheBudget(1 << 20);
+    search_server.AddDocument(1, "cat dog"s, DocumentStatus::ACTUAL, {1});
+    search_server.AddDocument(2, "cat"s, DocumentStatus::ACTUAL, {2});
+    search_server.AddDocument(3, "fish"s, DocumentStatus::ACTUAL, {3});
+    CountingStatistics statistics;
+    SearchOptions options;
+    options.corpus_statistics = &statistics;
+    // частоты спрашиваются по разу на плюс-слово, IDF = ln(100 / 10), у обоих документов ln(10)
+    const auto documents = search_server.FindTopDocuments("cat dog -bird"s, options);
+    ASSERT_EQUAL(statistics.calls.load(), 2);
+    ASSERT_EQUAL(GetIds(documents), (vector<int>{2, 1}));
+    ASSERT(abs(documents[0].relevance - log(10.0)) < 1e-9);
+    ASSERT(abs(documents[1].relevance - log(10.0)) < 1e-9);
+    // выдача с чужой статистикой не попадает в кэш
+    search_server.FindTopDocuments("cat dog -bird"s, options);
+    ASSERT_EQUAL(search_server.GetQueryCacheStats().hits, 0u);
+    ASSERT(abs(search_server.FindTopDocuments("cat dog -bird"s)[0].relevance - log(3.0) / 2 - log(1.5) / 2) < 1e-9);
+    // как и статистика, заданная серверу
+    const auto server_statistics = make_shared<CountingStatistics>();
+    search_server.SetCorpusStatistics(server_statistics);
+    const uint64_t hits = search_server.GetQueryCacheStats().hits;
+    search_server.FindTopDocuments("cat dog -bird"s);
+    ASSERT(abs(search_server.FindTopDocuments("cat dog -bird"s)[0].relevance - log(10.0)) < 1e-9);
+    ASSERT_EQUAL(server_statistics->calls.load(), 4);
+    ASSERT_EQUAL(search_server.GetQueryCacheStats().hits, hits);
+}
+
+void TestProcessQueries() {
+    mt19937 generator(5);
+    SearchServer search_server(""s);
+    for (int i = 0; i < 1000; ++i) {
+        search_server.AddDocument(i, GenerateSmallText(generator, 100, 10), DocumentStatus::ACTUAL, {i % 4});
+    }
+    vector<string> queries;
+    for (int i = 0; i < 300; ++i) {
+        queries.push_back(GenerateSmallQuery(generator, 100));
+    }
+    vector<vector<Document>> expected;
+    for (const string& query : queries) {
+        expected.push_back(search_server.FindTopDocuments(query));
+    }
+    const auto results = ProcessQueries(search_server, queries);
+    ASSERT_EQUAL(results.size(), queries.size());
+    for (size_t i = 0; i < queries.size(); ++i) {
+        AssertSameDocuments(results[i], expected[i], queries[i]);
+    }
+    for (const size_t thread_count : {size_t{0}, size_t{2}}) {
+        vector<vector<Document>> streamed;
+        ProcessQueriesStream(search_server, queries.begin(), queries.end(), back_inserter(streamed), {thread_count, 5});
+        ASSERT_EQUAL(streamed.size(), queries.size());
+        for (size_t i = 0; i < queries.size(); ++i) {
+            AssertSameDocuments(streamed[i], expected[i], queries[i]);
+        }
+    }
+    // неверный запрос: выдача до него получена, затем его исключение
+    vector<string> invalid_queries(queries.begin(), queries.begin() + 20);
+    invalid_queries.push_back("cat --dog"s);
+    invalid_queries.insert(invalid_queries.end(), queries.begin(), queries.begin() + 20);
+    size_t output_count = 0;
+    bool threw = false;
+    try {
+        ProcessQueriesStream(search_server, invalid_queries.begin(), invalid_queries.end(), [&output_count](const vector<Document>&) {
+            ++output_count;
+        });
+    } catch (const invalid_argument&) {
+        threw = true;
+    }
+    ASSERT(threw);
+    ASSERT_EQUAL(output_count, 20u);
+}
+
+void TestProcessQueriesJoined() {
+    mt19937 generator(5);
+    SearchServer search_server(""s);
+    for (int i = 0; i < 1000; ++i) {
+        search_server.AddDocument(i, GenerateSmallText(generator, 100, 10), DocumentStatus::ACTUAL, {i % 4});
+    }
+    vector<string> queries;
+    for (int i = 0; i < 300; ++i) {
+        queries.push_back(GenerateSmallQuery(generator, 100));
+    }
+    vector<vector<Document>> expected;
+    vector<Document> expected_joined;
+    for (const string& query : queries) {
+        expected.push_back(search_server.FindTopDocuments(query));
+        expected_joined.insert(expected_joined.end(), expected.back().begin(), expected.back().end());
+    }
+    AssertSameDocuments(ProcessQueriesJoined(search_server, queries), expected_joined, "joined"s);
+    const auto flat = ProcessQueriesFlat(search_server, queries);
+    ASSERT_EQUAL(flat.offsets.size(), queries.size() + 1);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        AssertSameDocuments(vector<Document>(flat.documents.begin() + flat.offsets[i], flat.documents.begin() + flat.offsets[i + 1]), expected[i], queries[i]);
+    }
+    // плоская выдача идёт через тот же кэш, что и ProcessQueries
+    search_server.SetQueryCacheBudget(1 << 22);
+    ProcessQueries(search_server, queries);
+    const uint64_t hits = search_server.GetQueryCacheStats().hits;
+    const auto cached = ProcessQueriesFlat(search_server, queries);
+    ASSERT_EQUAL(search_server.GetQueryCacheStats().hits, hits + queries.size());
+    ASSERT(cached.offsets == flat.offsets);
+    AssertSameDocuments(cached.documents, flat.documents, "cached flat"s);
+}
+
+void TestRequestQueue() {
+    SearchServer search_server("and"s);
+    search_server.AddDocument(1, "cat dog"s, DocumentStatus::ACTUAL, {1});
+    search_server.AddDocument(2, "cat bird"s, DocumentStatus::BANNED, {1});
+    {
+        RequestQueue request_queue(search_server);
+        for (int i = 0; i < 100; ++i) {
+            request_queue.AddFindRequest("empty request"s);
+        }
+        request_queue.AddFindRequest("cat"s);
+        request_queue.AddFindRequest("bird"s, DocumentStatus::BANNED);
+        ASSERT_EQUAL(request_queue.GetNoResultRequests(), 100);
+        const auto stats = request_queue.GetStats();
+        ASSERT_EQUAL(stats.request_count, 102u);
+        ASSERT_EQUAL(stats.result_counts.size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT) + 2);
+        ASSERT_EQUAL(stats.result_counts[0], 100u);
+        ASSERT_EQUAL(stats.result_counts[1], 2u);
+    }
+    {
+        // выдача глубже MAX_RESULT_DOCUMENT_COUNT: гистограмма по заданной глубине
+        RequestQueueOptions options;
+        options.max_result_count = 1000;
+        RequestQueue request_queue(search_server, options);
+        request_queue.RecordRequest(700, chrono::microseconds(1));
+        request_queue.RecordRequest(1000, chrono::microseconds(1));
+        request_queue.RecordRequest(5000, chrono::microseconds(1));
+        const auto stats = request_queue.GetStats();
+        ASSERT_EQUAL(stats.result_counts.size(), 1002u);
+        ASSERT_EQUAL(stats.result_counts[700], 1u);
+        ASSERT_EQUAL(stats.result_counts[1000], 1u);
+        ASSERT_EQUAL(stats.result_counts[1001], 1u);
+    }
+    {
+        RequestQueueOptions options;
+        options.window = chrono::minutes(10);
+        options.bucket_count = 10;
+        RequestQueue request_queue(search_server, options);
+        const auto start = chrono::steady_clock::time_point(chrono::hours(1000));
+        for (int minute = 0; minute < 30; ++minute) {
+            request_queue.RecordRequest(minute % 2 == 0 ? 3 : 0, chrono::microseconds(1000 * (minute + 1)),
+                                        start + chrono::minutes(minute) + chrono::seconds(1));
+        }
+        const auto now = start + chrono::minutes(29) + chrono::seconds(30);
+        // в окне только последние 10 минут
+        const auto stats = request_queue.GetStats(chrono::minutes(10), now);
+        ASSERT_EQUAL(stats.request_count, 10u);
+        ASSERT_EQUAL(stats.no_result_count, 5u);
+        ASSERT_EQUAL(stats.result_counts[3], 5u);
+        ASSERT_EQUAL(stats.GetLatencyQuantile(1.0).count(), 32768);
+        ASSERT_EQUAL(request_queue.GetStats(chrono::minutes(3), now).request_count, 3u);
+        // запись старше окна отбрасывается
+        request_queue.RecordRequest(0, chrono::microseconds(1), start + chrono::minutes(5));
+        ASSERT_EQUAL(request_queue.GetStats(chrono::minutes(10), now).request_count, 10u);
+        ASSERT_EQUAL(request_queue.GetStats(chrono::minutes(10), start + chrono::hours(2)).request_count, 0u);
+    }
+    {
+        RequestQueueOptions options;
+        options.window = chrono::hours(1);
+        options.bucket_count = 60;
+        RequestQueue request_queue(search_server, options);
+        vector<thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&request_queue] {
+                for (int i = 0; i < 10'000; ++i) {
+                    request_queue.RecordRequest(i % 3, chrono::microseconds(5));
+                }
+            });
+        }
+        for (thread& worker : threads) {
+            worker.join();
+        }
+        const auto stats = request_queue.GetStats();
+        ASSERT_EQUAL(stats.request_count, 40'000u);
+        ASSERT_EQUAL(stats.no_result_count, 4u * 3334);
+    }
+    bool threw = false;
+    try {
+        RequestQueueOptions options;
+        options.bucket_count = 0;
+        RequestQueue invalid(search_server, options);
+    } catch (const invalid_argument&) {
+        threw = true;
+    }
+    ASSERT(threw);
+}
+
+} // namespace
+
+void TestSearchServer() {
+    TestRunner tr;
+    RUN_TEST(tr, TestSnapshotRoundTrip);
+    RUN_TEST(tr, TestSnapshotResave);
+    RUN_TEST(tr, TestTombstonesAndCompact);
+    RUN_TEST(tr, TestForwardIndexRepack);
+    RUN_TEST(tr, TestSplitIntoWords);
+    RUN_TEST(tr, TestMatchDocumentParsesEachQuery);
+    RUN_TEST(tr, TestMatchDocuments);
+    RUN_TEST(tr, TestConcurrentReadWrite);
+    RUN_TEST(tr, TestParallelSearchMatchesSequential);
+    RUN_TEST(tr, TestUnboundedTopK);
+    RUN_TEST(tr, TestThreadPool);
+    RUN_TEST(tr, TestQueryCacheInvalidation);
+    RUN_TEST(tr, TestDuplicatePolicy);
+    RUN_TEST(tr, TestRemoveDuplicates);
+    RUN_TEST(tr, TestNearDuplicateIndex);
+    RUN_TEST(tr, TestServerNearDuplicateIndex);
+    RUN_TEST(tr, TestShardedSearchServer);
+    RUN_TEST(tr, TestQueryCorpusStatistics);
+    RUN_TEST(tr, TestProcessQueries);
+    RUN_TEST(tr, TestProcessQueriesJoined);
+    RUN_TEST(tr, TestRequestQueue);
+}
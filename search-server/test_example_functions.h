@@ -0,0 +1,20 @@
+#pragma once
+
+// Проверки поведения сервера на ASSERT из test_framework.h; при ошибке программа завершается.
+void TestSearchServer();
+
+// Замеры времени через LOG_DURATION на синтетическом корпусе.
+// Время индексации должно расти линейно с числом документов.
+void BenchmarkIngestion();
+
+// Пакетное добавление: последовательно и параллельно на одном корпусе.
+void BenchmarkBatchIngestion();
+
+// Сравнение полного перебора с Block-Max WAND на одних и тех же запросах.
+void BenchmarkDynamicPruning();
+
+// Повторное выполнение одних и тех же запросов: из текста и через PreparedQuery.
+void BenchmarkPreparedQueries();
+
+// Разбиение на слова: прежнее посимвольное с копированием слов против string_view и буфера вызывающего.
+void BenchmarkTokenizer();
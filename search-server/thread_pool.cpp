@@ -0,0 +1,116 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <utility>
+using namespace std;
+
+namespace {
+
+// пул и номер работника текущего потока
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_worker = 0;
+
+} // namespace
+
+ThreadPool::ThreadPool(size_t thread_count) {
+    if (thread_count == 0) {
+        thread_count = max(1u, thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < thread_count; ++i) {
+        queues_.push_back(make_unique<Queue>());
+    }
+    threads_.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        threads_.emplace_back([this, i] {
+            RunWorker(i);
+        });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard guard(sleep_mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (thread& worker : threads_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::Submit(function<void()> task) {
+    size_t index = GetWorkerIndex();
+    if (index == NO_WORKER) {
+        index = next_queue_.fetch_add(1, memory_order_relaxed) % queues_.size();
+    }
+    {
+        lock_guard guard(queues_[index]->mutex);
+        queues_[index]->tasks.push_back(move(task));
+    }
+    {
+        // счётчик меняется под sleep_mutex_, чтобы засыпающий работник не пропустил задачу
+        lock_guard guard(sleep_mutex_);
+        pending_.fetch_add(1, memory_order_relaxed);
+    }
+    wake_.notify_one();
+}
+
+bool ThreadPool::RunPendingTask() {
+    const size_t index = GetWorkerIndex();
+    function<void()> task;
+    if (!TryTake(index == NO_WORKER ? 0 : index, task)) {
+        return false;
+    }
+    task();
+    return true;
+}
+
+bool ThreadPool::IsWorkerThread() const {
+    return GetWorkerIndex() != NO_WORKER;
+}
+
+void ThreadPool::RunWorker(size_t index) {
+    current_pool = this;
+    current_worker = index;
+    function<void()> task;
+    while (true) {
+        if (TryTake(index, task)) {
+            task();
+            task = nullptr;
+            continue;
+        }
+        unique_lock lock(sleep_mutex_);
+        wake_.wait(lock, [this] {
+            return stop_ || pending_.load(memory_order_relaxed) > 0;
+        });
+        if (stop_ && pending_.load(memory_order_relaxed) == 0) {
+            return;
+        }
+    }
+}
+
+bool ThreadPool::TryTake(size_t index, function<void()>& task) {
+    if (pending_.load(memory_order_relaxed) == 0) {
+        return false;
+    }
+    for (size_t i = 0; i < queues_.size(); ++i) {
+        Queue& queue = *queues_[(index + i) % queues_.size()];
+        lock_guard guard(queue.mutex);
+        if (queue.tasks.empty()) {
+            continue;
+        }
+        if (i == 0) {
+            task = move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        pending_.fetch_sub(1, memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+size_t ThreadPool::GetWorkerIndex() const {
+    return current_pool == this ? current_worker : NO_WORKER;
+}
@@ -0,0 +1,140 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Политика выполнения для SearchServer: параллельные части идут на пул сервера.
+// grain - сколько элементов (документов, слов, частей пакета) берёт задача за раз;
+// 0 - поровну на потоки пула и вызывающий поток.
+struct PoolExecutionPolicy {
+    size_t grain = 0;
+};
+
+// Пул потоков с очередью задач у каждого работника. Задача, поставленная из работника,
+// попадает в его очередь и берётся оттуда с конца (свежие данные ещё в кэше), свободный
+// работник забирает задачи у других с начала. Поток, который ждёт свои задачи, может
+// выполнять чужие через RunPendingTask: так ожидание внутри работника не блокирует пул.
+// ParallelFor этого не делает: его куски разбирает и сам вызывающий поток.
+class ThreadPool {
+public:
+    // 0 - по числу ядер
+    explicit ThreadPool(size_t thread_count = 0);
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    // выполняет оставшиеся задачи и останавливает потоки
+    ~ThreadPool();
+
+    size_t GetThreadCount() const {
+        return threads_.size();
+    }
+
+    void Submit(std::function<void()> task);
+
+    // выполняет одну задачу из очередей пула в текущем потоке; false - задач нет
+    bool RunPendingTask();
+
+    // true, если текущий поток - работник этого пула
+    bool IsWorkerThread() const;
+
+    // function(index) для всех index из [0, count) кусками по grain (0 - поровну на потоки).
+    // Куски разбирают вызывающий поток и не больше GetThreadCount() задач пула. Вызывающий
+    // поток выполняет только куски этого вызова и ждёт лишь уже начатые, поэтому вложенный
+    // вызов из работника не блокирует пул, а вызов под блокировкой не выполняет под ней
+    // чужие задачи. Первое исключение пробрасывается после завершения всех кусков.
+    template <typename Function>
+    void ParallelFor(size_t count, size_t grain, Function function);
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    static const size_t NO_WORKER = static_cast<size_t>(-1);
+
+    void RunWorker(size_t index);
+
+    // своя очередь с конца, затем чужие с начала
+    bool TryTake(size_t index, std::function<void()>& task);
+
+    size_t GetWorkerIndex() const;
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> pending_{0};
+    std::atomic<size_t> next_queue_{0};
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    bool stop_ = false;
+};
+
+template <typename Function>
+void ThreadPool::ParallelFor(size_t count, size_t grain, Function function) {
+    if (grain == 0) {
+        grain = (count + threads_.size()) / (threads_.size() + 1);
+    }
+    grain = std::max<size_t>(grain, 1);
+    const size_t chunk_count = (count + grain - 1) / grain;
+    if (chunk_count <= 1) {
+        for (size_t i = 0; i < count; ++i) {
+            function(i);
+        }
+        return;
+    }
+
+    // задача-помощник может начаться уже после возврата, поэтому состояние у неё общее,
+    // а function она вызывает, только если успела взять кусок
+    struct State {
+        std::atomic<size_t> next_chunk{0};
+        std::atomic<size_t> finished{0};
+        std::mutex mutex;
+        std::condition_variable finished_condition;
+        std::exception_ptr error;
+    };
+    const auto state = std::make_shared<State>();
+    const auto run_chunks = [state, &function, count, grain, chunk_count] {
+        for (size_t chunk = state->next_chunk.fetch_add(1); chunk < chunk_count; chunk = state->next_chunk.fetch_add(1)) {
+            size_t done = 1;
+            try {
+                for (size_t i = chunk * grain; i < std::min(count, (chunk + 1) * grain); ++i) {
+                    function(i);
+                }
+            } catch (...) {
+                // оставшиеся куски никто не начнёт, они считаются завершёнными
+                const size_t claimed = state->next_chunk.exchange(chunk_count);
+                done += chunk_count - std::min(claimed, chunk_count);
+                std::lock_guard guard(state->mutex);
+                if (!state->error) {
+                    state->error = std::current_exception();
+                }
+            }
+            if (state->finished.fetch_add(done) + done == chunk_count) {
+                std::lock_guard guard(state->mutex);
+                state->finished_condition.notify_one();
+            }
+        }
+    };
+
+    const size_t helper_count = std::min(chunk_count - 1, threads_.size());
+    for (size_t i = 0; i < helper_count; ++i) {
+        Submit(run_chunks);
+    }
+    run_chunks();
+    // Все куски уже взяты, и каждый выполняется каким-то потоком, поэтому ожидание не
+    // блокирует пул. Чужие задачи вызывающий поток не выполняет: он может держать
+    // блокировки, о которых они не знают.
+    std::unique_lock lock(state->mutex);
+    state->finished_condition.wait(lock, [&state, chunk_count] {
+        return state->finished.load() == chunk_count;
+    });
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+}
@@ -0,0 +1,45 @@
+#include "top_documents.h"
+using namespace std;
+
+TopDocuments::TopDocuments(size_t capacity)
+    : capacity_(capacity) {
+    heap_.reserve(min<size_t>(capacity, 1024));
+}
+
+TopDocuments::TopDocuments(size_t capacity, vector<Document> buffer)
+    : capacity_(capacity)
+    , heap_(move(buffer)) {
+    heap_.clear();
+    heap_.reserve(min<size_t>(capacity, 1024));
+}
+
+void TopDocuments::Merge(const TopDocuments& other) {
+    for (const Document& document : other.heap_) {
+        Push(document);
+    }
+}
+
+vector<Document> TopDocuments::Extract(size_t offset) {
+    sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    vector<Document> result;
+    if (offset < heap_.size()) {
+        result.assign(heap_.begin() + offset, heap_.end());
+    }
+    heap_.clear();
+    return result;
+}
+
+void TopDocuments::ExtractTo(size_t offset, vector<Document>& result) {
+    sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    heap_.erase(heap_.begin(), heap_.begin() + min(offset, heap_.size()));
+    result = move(heap_);
+    heap_.clear();
+}
+
+vector<Document> SelectTopDocuments(const vector<Document>& documents, size_t top_k, size_t offset) {
+    TopDocuments top(GetTopCapacity(top_k, offset));
+    for (const Document& document : documents) {
+        top.Push(document);
+    }
+    return top.Extract(offset);
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "document.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+const double EPSILON=1e-6;
+
+// порядок выдачи: по убыванию релевантности, при равной релевантности - по убыванию рейтинга,
+// затем по возрастанию id, чтобы выдача не зависела от способа отбора
+inline bool IsMoreRelevant(const Document& lhs, const Document& rhs) {
+    if (std::abs(lhs.relevance - rhs.relevance) < EPSILON) {
+        if (lhs.rating != rhs.rating) {
+            return lhs.rating > rhs.rating;
+        }
+        return lhs.id < rhs.id;
+    }
+    return lhs.relevance > rhs.relevance;
+}
+
+// Хранит не более capacity лучших документов в куче, на вершине которой наименее
+// релевантный из них. Push стоит O(log capacity).
+class TopDocuments {
+public:
+    explicit TopDocuments(size_t capacity);
+    // под кучу берётся память buffer, его содержимое отбрасывается
+    TopDocuments(size_t capacity, std::vector<Document> buffer);
+
+    void Push(const Document& document) {
+        if (heap_.size() < capacity_) {
+            heap_.push_back(document);
+            std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        } else if (capacity_ > 0 && IsMoreRelevant(document, heap_.front())) {
+            std::pop_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+            heap_.back() = document;
+            std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        }
+    }
+
+    // когда куча заполнена, новый документ должен быть релевантнее GetWorst()
+    bool IsFull() const {
+        return heap_.size() == capacity_;
+    }
+
+    const Document& GetWorst() const {
+        return heap_.front();
+    }
+
+    void Merge(const TopDocuments& other);
+
+    // документы по убыванию релевантности без первых offset
+    std::vector<Document> Extract(size_t offset);
+    // то же, но результат отдаётся вместе с памятью кучи, без выделения новой
+    void ExtractTo(size_t offset, std::vector<Document>& result);
+
+private:
+    size_t capacity_;
+    std::vector<Document> heap_;
+};
+
+// ёмкость кучи для позиций [offset, offset + top_k); top_k = SIZE_MAX означает "все"
+inline size_t GetTopCapacity(size_t top_k, size_t offset) {
+    return top_k > SIZE_MAX - offset ? SIZE_MAX : top_k + offset;
+}
+
+std::vector<Document> SelectTopDocuments(const std::vector<Document>& documents, size_t top_k, size_t offset);